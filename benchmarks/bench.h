@@ -0,0 +1,106 @@
+#ifndef _CEXCEPTION_BENCH_H
+#define _CEXCEPTION_BENCH_H
+
+//Minimal harness shared by the host benchmarks: best-of-N timing and CSV/JSON result output.
+//Usage: <benchmark> [--json] [--iterations N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "application.h"
+#include "CException/CException.h"
+
+namespace bench {
+
+struct Result {
+	std::string name;
+	unsigned int threads;
+	unsigned int param;
+	double nsPerOp;
+};
+
+struct Options {
+	bool json = false;
+	unsigned int iterations = 100000;
+};
+
+static inline Options parse_options(int argc, char** argv) {
+	Options opt;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--json") == 0)
+			opt.json = true;
+		else if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+			opt.iterations = (unsigned int)strtoul(argv[++i], nullptr, 0);
+	}
+	return opt;
+}
+
+//best of several runs, in nanoseconds per call of f
+template<typename F>
+static double time_ns(unsigned int iterations, F&& f) {
+	typedef std::chrono::steady_clock clock;
+	double best = 1e30;
+	for(int run = 0; run < 5; run++) {
+		clock::time_point start = clock::now();
+		for(unsigned int i = 0; i < iterations; i++)
+			f();
+		double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+		if(ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+//Grow the registry so that `count` threads are registered: count-1 placeholder handles plus the calling
+//thread, registered last so a linear lookup would have to walk the whole table. Counts must increase.
+//Placeholders are 8 bytes apart and aligned, as real handles are: the registry index ignores the low bits.
+static inline void register_threads(unsigned int count) {
+	static uint64_t placeholders[1024];
+	static unsigned int placeholderCount = 0;
+	static bool selfRegistered = false;
+	void* self = __cexception_get_current_thread_handle();
+
+	if(count + 1 > __cexception_get_number_of_threads())
+		CEXCEPTION_SET_NUM_THREADS(count + 1);
+	if(selfRegistered)
+		__cexception_unregister_thread(self);
+	for(; placeholderCount + 1 < count; placeholderCount++)
+		__cexception_register_thread(&placeholders[placeholderCount], "placeholder", nullptr);
+	__cexception_register_thread(self, "bench", nullptr);
+	selfRegistered = true;
+}
+
+class Report {
+public:
+	explicit Report(const Options& opt) : json(opt.json) { }
+
+	void add(const std::string& name, unsigned int threads, unsigned int param, double nsPerOp) {
+		results.push_back(Result{ name, threads, param, nsPerOp });
+	}
+
+	//valueName names the last column for reports that measure something other than time
+	void print(const char* paramName = "param", const char* valueName = "ns_per_op") const {
+		if(json) {
+			printf("[\n");
+			for(size_t i = 0; i < results.size(); i++)
+				printf("  {\"name\": \"%s\", \"threads\": %u, \"%s\": %u, \"%s\": %.2f}%s\n", results[i].name.c_str(),
+						results[i].threads, paramName, results[i].param, valueName, results[i].nsPerOp, i + 1 < results.size() ? "," : "");
+			printf("]\n");
+		} else {
+			printf("name,threads,%s,%s\n", paramName, valueName);
+			for(size_t i = 0; i < results.size(); i++)
+				printf("%s,%u,%u,%.2f\n", results[i].name.c_str(), results[i].threads, results[i].param, results[i].nsPerOp);
+		}
+	}
+
+private:
+	bool json;
+	std::vector<Result> results;
+};
+
+}
+
+#endif // _CEXCEPTION_BENCH_H
@@ -0,0 +1,140 @@
+#include "bench.h"
+#include "CException/CExceptionParallel.h"
+#include <atomic>
+
+//Work wasted after a failure: units of work done after one chunk throws, averaged over --iterations / 1000 runs.
+//A loop is CHUNKS chunks of UNITS units (~100 ns each); chunk CHUNKS / 4 throws halfway through. Every variant
+//has `param` + 1 runners (the calling thread is one of them), and in every run all runners meet at a start
+//barrier before any of them works, so thread start-up and idle-worker wake-up are not measured.
+//  parallel_for        __cexception_parallel_for on a pool of `param` workers, CEXCEPTION_CHECKPOINT every unit
+//  parallel_for_chunk  the same without checkpoints, so the loop only stops starting new chunks
+//  threads_flag        the hand-rolled equivalent: `param` NEW_THREAD threads and the caller, each on a fixed
+//                      slice of the chunks, checking a shared stop flag (set by the thread that throws) before
+//                      every chunk
+
+static SerialLogHandler logger(LOG_LEVEL_WARN);
+
+static const uint32_t CHUNKS = 256;
+static const uint32_t UNITS = 64;
+static const uint32_t FAILING_CHUNK = CHUNKS / 4;
+
+static std::atomic<uint64_t> unitsDone(0);
+static std::atomic<uint64_t> unitsAtFailure(0);
+static volatile unsigned int sink;
+
+static void unit() {
+	for(int i = 0; i < 64; i++)
+		sink++;
+	unitsDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void fail() {
+	unitsAtFailure.store(unitsDone.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	Throw(0x42);
+}
+
+static std::atomic<unsigned int> arrived(0);
+static unsigned int runners;
+static std::atomic<unsigned int> runNumber(0);
+static __thread unsigned int runnerRun;
+
+static void start_run(unsigned int count) {
+	runners = count;
+	arrived.store(0);
+	runNumber.fetch_add(1);
+}
+
+//once per runner and run: wait until every runner of the run has got here
+static void start_barrier() {
+	unsigned int run = runNumber.load();
+	if(runnerRun == run)
+		return;
+	runnerRun = run;
+	arrived.fetch_add(1);
+	while(arrived.load() < runners)
+		os_thread_yield();
+}
+
+static void chunk(uint32_t index, const CExceptionRange* range) {
+	start_barrier();
+	for(uint32_t u = 0; u < UNITS; u++)
+	{
+		if(range)
+			CEXCEPTION_CHECKPOINT(range);
+		if(index == FAILING_CHUNK && u == UNITS / 2)
+			fail();
+		unit();
+	}
+}
+
+static uint64_t run_parallel_for(CExceptionPool* pool, bool checkpoints) {
+	unitsDone.store(0);
+	start_run(__cexception_pool_workers(pool) + 1);
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	Try {
+		cexception::parallel_for(pool, 0, CHUNKS, 1, [&](const CExceptionRange* range) {
+			chunk(range->begin, checkpoints ? range : nullptr);
+		});
+	} Catch(e) {
+	}
+	return unitsDone.load() - unitsAtFailure.load();
+}
+
+static std::atomic<bool> stopFlag(false);
+static uint32_t sliceCount;
+
+static void slice(void* arg) {
+	uint32_t w = (uint32_t)(uintptr_t)arg;
+	CEXCEPTION_T e;
+	Try {
+		for(uint32_t c = w * CHUNKS / sliceCount; c < (w + 1) * CHUNKS / sliceCount; c++)
+		{
+			if(stopFlag.load(std::memory_order_relaxed))
+				break;
+			chunk(c, nullptr);
+		}
+	} Catch(e) {
+		stopFlag.store(true, std::memory_order_relaxed);
+	}
+}
+
+static uint64_t run_threads_flag(uint32_t threads) {
+	unitsDone.store(0);
+	stopFlag.store(false);
+	sliceCount = threads + 1;
+	start_run(threads + 1);
+	unsigned int base = __cexception_get_active_thread_count();
+	for(uint32_t w = 0; w < threads; w++)
+		NEW_THREAD(nullptr, "slice", OS_THREAD_PRIORITY_DEFAULT, slice, (void*)(uintptr_t)w, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+	slice((void*)(uintptr_t)threads);
+	while(__cexception_get_active_thread_count() > base)
+		os_thread_yield();
+	return unitsDone.load() - unitsAtFailure.load();
+}
+
+static const unsigned int workerCounts[] = { 1, 2, 4, 8 };
+
+int main(int argc, char** argv) {
+	bench::Options opt = bench::parse_options(argc, argv);
+	bench::Report report(opt);
+	CEXCEPTION_SET_NUM_THREADS(64);
+	unsigned int runs = opt.iterations / 1000 ? opt.iterations / 1000 : 1;
+
+	for(unsigned int workers : workerCounts) {
+		CExceptionPool* pool = NEW_POOL("bench", workers, OS_THREAD_PRIORITY_DEFAULT, OS_THREAD_STACK_SIZE_DEFAULT);
+		uint64_t checked = 0, unchecked = 0, flagged = 0;
+		for(unsigned int i = 0; i < runs; i++) {
+			checked += run_parallel_for(pool, true);
+			unchecked += run_parallel_for(pool, false);
+			flagged += run_threads_flag(workers);
+		}
+		__cexception_pool_destroy(pool);
+
+		report.add("parallel_for", 1, workers, (double)checked / runs);
+		report.add("parallel_for_chunk", 1, workers, (double)unchecked / runs);
+		report.add("threads_flag", 1, workers, (double)flagged / runs);
+	}
+
+	report.print("workers", "wasted_units");
+	return 0;
+}
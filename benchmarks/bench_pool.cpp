@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "CException/CExceptionPool.h"
+#include <atomic>
+
+//Cost of running a short job on another thread, per job (wall time for a batch divided by its size).
+//  pool               POOL_SUBMIT to a pool of `param` workers, then wait for the batch
+//  pool_throw         the same with every job throwing (the worker catches and calls the callback)
+//  new_thread         one NEW_THREAD per job, at most `param` running at once
+//Each job does the same small amount of work (~100 ns). --iterations sets the pool batch size; new_thread
+//runs a tenth of it.
+
+static SerialLogHandler logger(LOG_LEVEL_WARN);
+
+static std::atomic<unsigned int> jobsDone(0);
+static volatile unsigned int sink;
+
+static void work() {
+	for(int i = 0; i < 64; i++)
+		sink++;
+}
+
+static void job(void*) {
+	work();
+	jobsDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void throwing_job(void*) {
+	work();
+	Throw(0x42);
+}
+
+static void job_failed(CEXCEPTION_T, CExceptionThreadInfo*) {
+	jobsDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+static double run_pool(unsigned int workers, unsigned int jobs, void(*fun)(void*)) {
+	CExceptionPool* pool = NEW_POOL("bench", workers, OS_THREAD_PRIORITY_DEFAULT, OS_THREAD_STACK_SIZE_DEFAULT);
+	double ns = bench::time_ns(1, [&]() {
+		for(unsigned int i = 0; i < jobs; i++)
+			POOL_SUBMIT(pool, fun, nullptr, job_failed);
+		__cexception_pool_wait(pool);
+	});
+	__cexception_pool_destroy(pool);
+	return ns / jobs;
+}
+
+static double run_new_thread(unsigned int inFlight, unsigned int jobs) {
+	double ns = bench::time_ns(1, [&]() {
+		unsigned int base = __cexception_get_active_thread_count();
+		jobsDone.store(0);
+		for(unsigned int i = 0; i < jobs; i++)
+		{
+			//a thread leaves the registry only after its job is counted, so throttle on the registry
+			while(__cexception_get_active_thread_count() >= base + inFlight)
+				os_thread_yield();
+			NEW_THREAD(nullptr, "job", OS_THREAD_PRIORITY_DEFAULT, job, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+		}
+		while(__cexception_get_active_thread_count() > base)
+			os_thread_yield();
+	});
+	return ns / jobs;
+}
+
+static const unsigned int workerCounts[] = { 1, 2, 4, 8 };
+
+int main(int argc, char** argv) {
+	bench::Options opt = bench::parse_options(argc, argv);
+	bench::Report report(opt);
+	CEXCEPTION_SET_NUM_THREADS(64);
+
+	for(unsigned int workers : workerCounts) {
+		report.add("pool", 1, workers, run_pool(workers, opt.iterations, job));
+		report.add("pool_throw", 1, workers, run_pool(workers, opt.iterations, throwing_job));
+		report.add("new_thread", 1, workers, run_new_thread(workers, opt.iterations / 10));
+	}
+
+	report.print("workers");
+	return 0;
+}
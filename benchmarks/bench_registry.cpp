@@ -0,0 +1,64 @@
+#include "bench.h"
+
+//Registry operations keyed by thread handle, with `param` handles registered.
+//  lookup      __cexception_get_task_number for a registered handle
+//  churn       unregister one handle and register a new one in its place
+//  miss        __cexception_get_task_number for a handle that is not registered
+
+static SerialLogHandler logger(LOG_LEVEL_WARN);
+
+static volatile unsigned int sink;
+
+static const unsigned int MAX_HANDLES = 1024;
+//stand-ins for thread handles: aligned and spaced like real ones (the index ignores the low bits), and large
+//enough for the host to read a thread name through them when one is unregistered
+struct alignas(16) Placeholder {
+	uint8_t bytes[64];
+};
+static Placeholder handles[MAX_HANDLES * 2];
+
+int main(int argc, char** argv) {
+	bench::Options opt = bench::parse_options(argc, argv);
+	bench::Report report(opt);
+
+	unsigned int registered = 0;
+	for(unsigned int count = 16; count <= MAX_HANDLES; count *= 4) {
+		for(; registered < count; registered++)
+			__cexception_register_thread(&handles[registered], "placeholder", nullptr);
+
+		unsigned int next = 0;
+		report.add("lookup", 1, count, bench::time_ns(opt.iterations, [&]() {
+			sink += __cexception_get_task_number(&handles[next]);
+			next = next + 1 < count ? next + 1 : 0;
+		}));
+
+		report.add("miss", 1, count, bench::time_ns(opt.iterations, [&]() {
+			sink += __cexception_get_task_number(&handles[MAX_HANDLES + next]);
+			next = next + 1 < count ? next + 1 : 0;
+		}));
+
+		//swap handle i for its twin at i + MAX_HANDLES and back again on the next pass
+		next = 0;
+		bool swapped = false;
+		report.add("churn", 1, count, bench::time_ns(opt.iterations, [&]() {
+			Placeholder* from = &handles[next + (swapped ? MAX_HANDLES : 0)];
+			Placeholder* to = &handles[next + (swapped ? 0 : MAX_HANDLES)];
+			__cexception_unregister_thread(from);
+			sink += __cexception_register_thread(to, "placeholder", nullptr);
+			if(++next == count) {
+				next = 0;
+				swapped = !swapped;
+			}
+		}));
+		//put the original handles back so the next size starts from the same state
+		for(unsigned int i = 0; i < count; i++) {
+			if((i < next) != swapped) {
+				__cexception_unregister_thread(&handles[MAX_HANDLES + i]);
+				__cexception_register_thread(&handles[i], "placeholder", nullptr);
+			}
+		}
+	}
+
+	report.print("handles");
+	return 0;
+}
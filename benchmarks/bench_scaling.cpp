@@ -0,0 +1,151 @@
+#include "bench.h"
+#include <atomic>
+#include <thread>
+
+//Aggregate Try/Throw throughput with 1..16 threads running at once, each in its own registered slot.
+//ns_per_op is wall time divided by the total number of operations of all threads, so it falls with the
+//thread count as long as the threads do not contend (up to the number of cores).
+//  try_empty          Try/Catch with no throw
+//  try_throw          Try { Throw(); } Catch
+//  frame_packed       the frame writes of a Try, on frames packed next to each other (the old layout)
+//  frame_padded       the same on frames one cache line apart (the current layout)
+//The frame_* rows isolate the false-sharing cost from everything else a Try does.
+
+static SerialLogHandler logger(LOG_LEVEL_WARN);
+
+static const unsigned int MAX_THREADS = 16;
+
+struct PackedFrame {
+	void* volatile pFrame;
+	volatile CEXCEPTION_T Exception;
+};
+
+struct alignas(CEXCEPTION_CACHE_LINE) PaddedFrame {
+	void* volatile pFrame;
+	volatile CEXCEPTION_T Exception;
+};
+
+static PackedFrame packedFrames[MAX_THREADS];
+static PaddedFrame paddedFrames[MAX_THREADS];
+
+template<typename Frame>
+static inline void frame_op(Frame& f, unsigned int i) {
+	void* prev = f.pFrame;
+	f.pFrame = &prev;
+	f.Exception = CEXCEPTION_NONE;
+	f.Exception = i;
+	f.pFrame = prev;
+}
+
+enum Op { OP_TRY_EMPTY, OP_TRY_THROW, OP_FRAME_PACKED, OP_FRAME_PADDED };
+
+struct Run {
+	Op op;
+	unsigned int iterations;
+	std::atomic<unsigned int> ready;
+	std::atomic<unsigned int> done;
+	std::atomic<bool> go;
+	std::atomic<unsigned int> sink;
+};
+
+struct Worker {
+	Run* run;
+	unsigned int index;
+};
+
+static void worker(void* arg) {
+	Worker* w = (Worker*)arg;
+	Run* run = w->run;
+	unsigned int local = 0;
+
+	run->ready.fetch_add(1);
+	while(!run->go.load())
+		std::this_thread::yield();
+
+	for(unsigned int i = 0; i < run->iterations; i++) {
+		CEXCEPTION_T e;
+		switch(run->op) {
+		case OP_TRY_EMPTY:
+			Try {
+				local++;
+			} Catch(e) {
+				local--;
+			}
+			break;
+		case OP_TRY_THROW:
+			Try {
+				Throw(i);
+			} Catch(e) {
+				local += e;
+			}
+			break;
+		case OP_FRAME_PACKED:
+			frame_op(packedFrames[w->index], i);
+			break;
+		case OP_FRAME_PADDED:
+			frame_op(paddedFrames[w->index], i);
+			break;
+		}
+	}
+
+	run->sink.fetch_add(local);
+	run->done.fetch_add(1);
+}
+
+//wall time of `threads` workers doing `iterations` operations each, in ns per operation over all threads
+static double run_threads(Op op, unsigned int threads, unsigned int iterations) {
+	typedef std::chrono::steady_clock clock;
+	static Worker workers[MAX_THREADS];
+	double best = 1e30;
+
+	for(int attempt = 0; attempt < 3; attempt++) {
+		Run run;
+		run.op = op;
+		run.iterations = iterations;
+		run.ready.store(0);
+		run.done.store(0);
+		run.go.store(false);
+		run.sink.store(0);
+
+		for(unsigned int t = 0; t < threads; t++) {
+			workers[t] = Worker{ &run, t };
+			NEW_THREAD(nullptr, "bench", OS_THREAD_PRIORITY_DEFAULT, worker, &workers[t], OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+		}
+		while(run.ready.load() < threads)
+			delay(1);
+
+		clock::time_point start = clock::now();
+		run.go.store(true);
+		while(run.done.load() < threads)
+			std::this_thread::yield();
+		double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ((double)iterations * threads);
+		if(ns < best)
+			best = ns;
+
+		//let the workers unregister before the next round reuses their slots
+		while(__cexception_get_active_thread_count() != 0)
+			delay(1);
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	bench::Options opt = bench::parse_options(argc, argv);
+	bench::Report report(opt);
+
+	CEXCEPTION_SET_NUM_THREADS(MAX_THREADS * 2);
+
+	static const struct { const char* name; Op op; } ops[] = {
+		{ "try_empty", OP_TRY_EMPTY },
+		{ "try_throw", OP_TRY_THROW },
+		{ "frame_packed", OP_FRAME_PACKED },
+		{ "frame_padded", OP_FRAME_PADDED },
+	};
+
+	for(auto& o : ops)
+		for(unsigned int threads = 1; threads <= MAX_THREADS; threads *= 2)
+			report.add(o.name, threads, std::thread::hardware_concurrency(), run_threads(o.op, threads, opt.iterations));
+
+	report.print("cores");
+	return 0;
+}
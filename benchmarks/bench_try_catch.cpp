@@ -0,0 +1,240 @@
+#include "bench.h"
+#include <mutex>
+
+//Cost of the CException primitives against native C++ exceptions and expected-style error returns.
+//  try_empty          Try/Catch with no throw
+//  throw_depth        Throw from `param` calls below the catching Try
+//  exit_try           Try { ExitTry(); }
+//  attempt_empty      cexception::attempt with no throw
+//  attempt_throw_depth  the same as throw_depth with cexception::attempt
+//  try_nested         `param` nested Try levels, no throw
+//  attempt_nested     the same with cexception::attempt sharing one Context
+//  lock_safe          BEGIN_LOCK_SAFE/END_LOCK_SAFE with no throw
+//  lock_safe_throw    Throw from inside `param` nested BEGIN_LOCK_SAFE sections (one per call level)
+//  rethrow_depth      Throw through `param` levels that each Catch, clean up and rethrow
+//  cleanup_depth      the same with a BEGIN_CLEANUP pass-through block per level
+//  native_*           the same shapes with C++ try/throw/catch
+//  expected_depth     an error code returned up through `param` calls
+//Each CException case is run with 1..256 registered threads.
+
+static SerialLogHandler logger(LOG_LEVEL_WARN);
+
+static volatile unsigned int sink;
+
+static __attribute__((noinline)) void cexception_thrower(unsigned int depth) {
+	if(depth <= 1)
+		Throw(0x42);
+	cexception_thrower(depth - 1);
+	sink++;
+}
+
+static __attribute__((noinline)) void native_thrower(unsigned int depth) {
+	if(depth <= 1)
+		throw 0x42;
+	native_thrower(depth - 1);
+	sink++;
+}
+
+//what std::expected<void, int> boils down to
+struct Expected {
+	bool ok;
+	int error;
+};
+
+static __attribute__((noinline)) Expected expected_thrower(unsigned int depth) {
+	if(depth <= 1)
+		return Expected{ false, 0x42 };
+	Expected r = expected_thrower(depth - 1);
+	if(!r.ok)
+		return r;
+	sink++;
+	return Expected{ true, 0 };
+}
+
+static std::mutex lock_chain[8];
+
+static __attribute__((noinline)) void lock_safe_thrower(unsigned int depth) {
+	if(depth == 0)
+		Throw(0x42);
+	BEGIN_LOCK_SAFE(lock_chain[depth - 1])
+	{
+		lock_safe_thrower(depth - 1);
+	} END_LOCK_SAFE();
+	sink++;
+}
+
+static __attribute__((noinline)) void rethrow_thrower(unsigned int depth) {
+	if(depth == 0)
+		Throw(0x42);
+	CEXCEPTION_T e;
+	Try {
+		rethrow_thrower(depth - 1);
+	} Catch(e) {
+		sink++;
+		Throw(e);
+	}
+	sink++;
+}
+
+static __attribute__((noinline)) void cleanup_thrower(unsigned int depth) {
+	if(depth == 0)
+		Throw(0x42);
+	BEGIN_CLEANUP([]() { sink++; })
+	{
+		cleanup_thrower(depth - 1);
+	} END_CLEANUP();
+	sink++;
+}
+
+static __attribute__((noinline)) void try_nested(unsigned int depth) {
+	CEXCEPTION_T e;
+	Try {
+		if(depth > 1)
+			try_nested(depth - 1);
+		sink++;
+	} Catch(e) {
+		sink--;
+	}
+}
+
+static __attribute__((noinline)) void attempt_nested(const cexception::Context& ctx, unsigned int depth) {
+	ctx.attempt([&]() {
+		if(depth > 1)
+			attempt_nested(ctx, depth - 1);
+		sink++;
+	}, [](CEXCEPTION_T) {
+		sink--;
+	});
+}
+
+static const unsigned int depths[] = { 1, 2, 4, 8, 16, 32, 64 };
+static const unsigned int lock_depths[] = { 1, 2, 4, 8 };
+
+int main(int argc, char** argv) {
+	bench::Options opt = bench::parse_options(argc, argv);
+	bench::Report report(opt);
+	std::mutex mutex;
+
+	for(unsigned int threads = 1; threads <= 256; threads *= 2) {
+		bench::register_threads(threads);
+
+		report.add("try_empty", threads, 0, bench::time_ns(opt.iterations, [&]() {
+			CEXCEPTION_T e;
+			Try {
+				sink++;
+			} Catch(e) {
+				sink--;
+			}
+		}));
+
+		for(unsigned int depth : depths) {
+			report.add("throw_depth", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				CEXCEPTION_T e;
+				Try {
+					cexception_thrower(depth);
+				} Catch(e) {
+					sink += e;
+				}
+			}));
+		}
+
+		report.add("exit_try", threads, 0, bench::time_ns(opt.iterations, [&]() {
+			CEXCEPTION_T e;
+			Try {
+				ExitTry();
+			} Catch(e) {
+				sink--;
+			}
+		}));
+
+		report.add("attempt_empty", threads, 0, bench::time_ns(opt.iterations, [&]() {
+			cexception::attempt([]() {
+				sink++;
+			}, [](CEXCEPTION_T) {
+				sink--;
+			});
+		}));
+
+		for(unsigned int depth : depths) {
+			report.add("attempt_throw_depth", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				cexception::attempt([&]() {
+					cexception_thrower(depth);
+				}, [](CEXCEPTION_T e) {
+					sink += e;
+				});
+			}));
+		}
+
+		for(unsigned int depth : lock_depths) {
+			report.add("try_nested", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				try_nested(depth);
+			}));
+			report.add("attempt_nested", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				attempt_nested(cexception::Context(), depth);
+			}));
+		}
+
+		report.add("lock_safe", threads, 0, bench::time_ns(opt.iterations, [&]() {
+			BEGIN_LOCK_SAFE(mutex)
+			{
+				sink++;
+			} END_LOCK_SAFE();
+		}));
+
+		for(unsigned int depth : depths) {
+			report.add("rethrow_depth", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				CEXCEPTION_T e;
+				Try {
+					rethrow_thrower(depth);
+				} Catch(e) {
+					sink += e;
+				}
+			}));
+			report.add("cleanup_depth", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				CEXCEPTION_T e;
+				Try {
+					cleanup_thrower(depth);
+				} Catch(e) {
+					sink += e;
+				}
+			}));
+		}
+
+		for(unsigned int depth : lock_depths) {
+			report.add("lock_safe_throw", threads, depth, bench::time_ns(opt.iterations, [&]() {
+				CEXCEPTION_T e;
+				Try {
+					lock_safe_thrower(depth);
+				} Catch(e) {
+					sink += e;
+				}
+			}));
+		}
+	}
+
+	report.add("native_try_empty", 0, 0, bench::time_ns(opt.iterations, [&]() {
+		try {
+			sink++;
+		} catch(int e) {
+			sink--;
+		}
+	}));
+
+	for(unsigned int depth : depths) {
+		report.add("native_throw_depth", 0, depth, bench::time_ns(opt.iterations, [&]() {
+			try {
+				native_thrower(depth);
+			} catch(int e) {
+				sink += e;
+			}
+		}));
+		report.add("expected_depth", 0, depth, bench::time_ns(opt.iterations, [&]() {
+			Expected r = expected_thrower(depth);
+			if(!r.ok)
+				sink += r.error;
+		}));
+	}
+
+	report.print("depth");
+	return 0;
+}
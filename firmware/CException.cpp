@@ -1,23 +1,469 @@
 #include "CException.h"
+#include "CExceptionEvents.h"
+#include "CExceptionTrace.h"
+#include "CExceptionProfiler.h"
+#include "CExceptionBacktrace.h"
+#include "CExceptionIds.h"
+#include "CExceptionStacks.h"
 #include "application.h"
+#ifndef CEXCEPTION_PLATFORM_HOST
 #include "core_cm3.h"
+#endif
 #include <mutex>
+#include <atomic>
+#include <new>
 #include "logging.h"
 
 LOG_SOURCE_CATEGORY("cexception");
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
-static CEXCEPTION_FRAME_T DefaultCExceptionFrame = { 0 };
-#pragma GCC diagnostic pop
+#if CEXCEPTION_METRICS
+#include "CExceptionMetrics.h"
+
+#if CEXCEPTION_METRICS_IDS & (CEXCEPTION_METRICS_IDS - 1)
+#error "CEXCEPTION_METRICS_IDS must be a power of two"
+#endif
+
+//a thread's counters besides Tries, which is in its frame so that the Try macro can reach it; single writer
+struct CExceptionMetricsState {
+	volatile uint32_t throws;
+	volatile uint32_t catches;
+	volatile uint32_t throwTime;
+	volatile uint32_t latency[CEXCEPTION_METRICS_LATENCY_BUCKETS];
+};
+#endif
+
+#if CEXCEPTION_MULTI_TASK
+//Everything kept per thread: the Try frame, the thread info (handle, callback, fault data), the free-list
+//link and the function NEW_THREAD started the thread with. Each context starts on its own cache line, so a
+//Try/Throw on one thread never writes a line that another thread is using (the old parallel frame/info arrays
+//packed several threads' frames into one line).
+struct alignas(CEXCEPTION_CACHE_LINE) CExceptionContext {
+	volatile CEXCEPTION_FRAME_T frame;
+	volatile CExceptionThreadInfo info;
+	std::atomic<unsigned int> nextFree;
+	//set by __cexception_thread_create under taskLock, read by the thread wrapper once it has the lock; kept in
+	//the slot so that starting a thread allocates nothing but the OS stack
+	void (*launchFunc)(void*);
+	void* launchArg;
+#if CEXCEPTION_STACK_USAGE
+	//the thread's stack, painted by the thread wrapper; stackPeak is refreshed by every report and on unregister
+	uint32_t* volatile stackLow;
+	volatile uint32_t stackSize;
+	volatile uint32_t stackPeak;
+#endif
+#if CEXCEPTION_METRICS
+	CExceptionMetricsState metrics;
+#endif
+};
+
+static CExceptionContext DefaultCExceptionContext;
+#if CEXCEPTION_STACK_USAGE
+volatile CEXCEPTION_FRAME_T* const __cexception_shared_frame = &DefaultCExceptionContext.frame;
+#endif
 
 static std::mutex taskLock;
 
-static volatile unsigned int CException_Num_Tasks = 1;
-volatile CEXCEPTION_FRAME_T * volatile CExceptionFrames = &DefaultCExceptionFrame;
-static volatile CExceptionThreadInfo * volatile TaskIds = nullptr;
+//Thread registry
+//
+//Slot 0 is shared by every thread that is not registered. Per-slot contexts are allocated in blocks when the
+//table grows and never move or get freed, so a Try (or a cached lookup) can keep pointers to them
+//indefinitely. The table itself only holds pointers to those contexts; growing it publishes a new table
+//with a single atomic store and retires the old one.
+//
+//Readers never lock. Anything that walks a table does so inside a read-side section (__cexception_read_lock),
+//which bumps one of two reader counters selected by the epoch parity. A retired table is freed only after the
+//epoch has advanced and the counter of the previous parity has drained, i.e. once nobody who could have loaded
+//it is still reading.
+//
+//Each table also carries an open-addressing index from thread handle to slot (linear probing, capacity a power
+//of two at least twice the slot count). An inserter claims an entry by CAS to RESERVED, writes the slot and
+//then publishes the key; removals leave a tombstone, and a reader confirms a hit against the slot's handle, so
+//a lookup racing an unregister can miss but never return another thread's slot. Tombstones are purged by
+//republishing the table.
+//
+//Free slots form a lock-free stack (index + ABA tag packed into one word) and the number of registered threads
+//is a counter, so registering and unregistering are O(1) and take no lock. Publishing a new table (growth,
+//index purge) is the only operation that needs taskLock: it raises CExceptionTableResizing and waits for
+//in-flight registry writers to leave; writers that see the flag fall back to taskLock.
+#define CEXCEPTION_INDEX_TOMBSTONE ((void*)UINTPTR_MAX)
+#define CEXCEPTION_INDEX_RESERVED ((void*)(UINTPTR_MAX - 1))
+
+struct CExceptionTable {
+	unsigned int size;
+	CExceptionTable* retiredNext;
+	CExceptionContext** contexts;
+	unsigned int indexMask;
+	volatile unsigned int indexTombstones;
+	std::atomic<void*>* indexKeys;
+	volatile unsigned int* indexSlots;
+};
+
+#define CEXCEPTION_FREE_SLOT_MASK 0xffffu
+#define CEXCEPTION_FREE_TAG_STEP 0x10000u
+
+static CExceptionContext* DefaultContextList[1] = { &DefaultCExceptionContext };
+static std::atomic<void*> DefaultIndexKeys[2];
+static volatile unsigned int DefaultIndexSlots[2];
+static CExceptionTable DefaultTable = { 1, nullptr, DefaultContextList, 1, 0, DefaultIndexKeys, DefaultIndexSlots };
+
+static std::atomic<CExceptionTable*> CExceptionActiveTable(&DefaultTable);
+static std::atomic<unsigned int> CExceptionReadEpoch(0);
+static std::atomic<unsigned int> CExceptionReaders[2];
+static CExceptionTable* CExceptionRetiredTables = nullptr;
+static bool CExceptionRetiredFlipped = false;
+
+static std::atomic<uint32_t> CExceptionFreeSlots(0);
+static std::atomic<unsigned int> CExceptionActiveThreads(0);
+static std::atomic<unsigned int> CExceptionRegistryWriters(0);
+static std::atomic<bool> CExceptionTableResizing(false);
+static std::atomic<bool> CExceptionReclaimPending(false);
+
+static unsigned int __cexception_read_lock() {
+	for(;;)
+	{
+		unsigned int epoch = CExceptionReadEpoch.load();
+		CExceptionReaders[epoch & 1].fetch_add(1);
+		if(CExceptionReadEpoch.load() == epoch)
+			return epoch;
+		CExceptionReaders[epoch & 1].fetch_sub(1);
+	}
+}
+
+static void __cexception_read_unlock(unsigned int epoch) {
+	CExceptionReaders[epoch & 1].fetch_sub(1);
+}
+
+//free retired tables if no reader can still see them; otherwise leave them for a later attempt (taskLock held)
+static void __cexception_reclaim_tables() {
+	if(CExceptionRetiredTables == nullptr)
+		return;
+
+	unsigned int epoch = CExceptionReadEpoch.load();
+	if(!CExceptionRetiredFlipped)
+	{
+		//readers from an older epoch still hold the other parity
+		if(CExceptionReaders[(epoch + 1) & 1].load() != 0)
+			return;
+		CExceptionReadEpoch.store(++epoch);
+		CExceptionRetiredFlipped = true;
+	}
+	if(CExceptionReaders[(epoch + 1) & 1].load() != 0)
+		return;
+
+	while(CExceptionRetiredTables)
+	{
+		CExceptionTable* table = CExceptionRetiredTables;
+		CExceptionRetiredTables = table->retiredNext;
+		free(table);
+	}
+	CExceptionRetiredFlipped = false;
+}
+
+static inline unsigned int __cexception_index_hash(const void* handle, unsigned int mask) {
+	//Fibonacci hashing; handles are aligned heap/TCB addresses, so the low bits carry little information
+	return (unsigned int)((((uintptr_t)handle >> 3) * 2654435769u) >> 7) & mask;
+}
+
+//returns the slot registered for handle, or 0 (read-side section or taskLock required)
+static unsigned int __cexception_index_find(CExceptionTable* table, const void* handle) {
+	if(handle == nullptr)
+		return 0;
+	unsigned int i = __cexception_index_hash(handle, table->indexMask);
+	for(unsigned int probes = 0; probes <= table->indexMask; probes++, i = (i + 1) & table->indexMask)
+	{
+		void* key = table->indexKeys[i].load(std::memory_order_acquire);
+		if(key == nullptr)
+			return 0;
+		if(key == handle)
+		{
+			unsigned int slot = table->indexSlots[i];
+			return slot < table->size && table->contexts[slot]->info.handle == handle ? slot : 0;
+		}
+	}
+	return 0;
+}
+
+//registry writer or taskLock; the index always has at least size free entries, so probing terminates
+static void __cexception_index_insert(CExceptionTable* table, void* handle, unsigned int slot) {
+	unsigned int i = __cexception_index_hash(handle, table->indexMask);
+	for(;; i = (i + 1) & table->indexMask)
+	{
+		void* key = table->indexKeys[i].load(std::memory_order_relaxed);
+		if((key == nullptr || key == CEXCEPTION_INDEX_TOMBSTONE) &&
+				table->indexKeys[i].compare_exchange_strong(key, CEXCEPTION_INDEX_RESERVED))
+		{
+			if(key == CEXCEPTION_INDEX_TOMBSTONE)
+				__atomic_fetch_sub(&table->indexTombstones, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	table->indexSlots[i] = slot;
+	table->indexKeys[i].store(handle, std::memory_order_release);
+}
+
+//registry writer or taskLock; only the thread that unpublished the handle removes it
+static void __cexception_index_remove(CExceptionTable* table, const void* handle) {
+	unsigned int i = __cexception_index_hash(handle, table->indexMask);
+	for(unsigned int probes = 0; probes <= table->indexMask; probes++, i = (i + 1) & table->indexMask)
+	{
+		void* key = table->indexKeys[i].load(std::memory_order_relaxed);
+		if(key == nullptr)
+			return;
+		if(key == handle)
+		{
+			table->indexKeys[i].store(CEXCEPTION_INDEX_TOMBSTONE, std::memory_order_release);
+			__atomic_fetch_add(&table->indexTombstones, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+//pop a free slot, or 0 if there is none (registry writer or taskLock)
+static unsigned int __cexception_pop_free_slot(CExceptionTable* table) {
+	uint32_t head = CExceptionFreeSlots.load();
+	for(;;)
+	{
+		unsigned int slot = head & CEXCEPTION_FREE_SLOT_MASK;
+		if(slot == 0)
+			return 0;
+		uint32_t next = ((head & ~CEXCEPTION_FREE_SLOT_MASK) + CEXCEPTION_FREE_TAG_STEP) |
+				table->contexts[slot]->nextFree.load();
+		if(CExceptionFreeSlots.compare_exchange_weak(head, next))
+			return slot;
+	}
+}
+
+static void __cexception_push_free_slot(CExceptionTable* table, unsigned int slot) {
+	uint32_t head = CExceptionFreeSlots.load();
+	do
+	{
+		table->contexts[slot]->nextFree.store(head & CEXCEPTION_FREE_SLOT_MASK);
+	} while(!CExceptionFreeSlots.compare_exchange_weak(head,
+			((head & ~CEXCEPTION_FREE_SLOT_MASK) + CEXCEPTION_FREE_TAG_STEP) | slot));
+}
+
+//Registry writers (register/unregister outside taskLock) bracket their work with these. Entering fails while
+//a table is being published; the caller then retries under taskLock.
+static bool __cexception_enter_registry_writer() {
+	CExceptionRegistryWriters.fetch_add(1);
+	if(!CExceptionTableResizing.load())
+		return true;
+	CExceptionRegistryWriters.fetch_sub(1);
+	return false;
+}
+
+static void __cexception_exit_registry_writer() {
+	CExceptionRegistryWriters.fetch_sub(1);
+}
+
+//publish a table with num slots (taskLock held); num == current size just rebuilds the index.
+//Returns false if memory is exhausted.
+static bool __cexception_grow_table(unsigned int num) {
+	CExceptionTable* current = CExceptionActiveTable.load();
+	unsigned int added = num - current->size;
+	if(num > CEXCEPTION_FREE_SLOT_MASK)
+		return false;
+	unsigned int indexSize = 2;
+	while(indexSize < num * 2)
+		indexSize <<= 1;
+
+	CExceptionTable* table = (CExceptionTable*)malloc(sizeof(CExceptionTable) + num * sizeof(CExceptionContext*) +
+			indexSize * (sizeof(std::atomic<void*>) + sizeof(unsigned int)));
+	//malloc only guarantees 8-byte alignment; the block is never freed, so it is simply over-allocated
+	void* newBlock = added ? malloc(added * sizeof(CExceptionContext) + CEXCEPTION_CACHE_LINE - 1) : nullptr;
+	if(table == nullptr || (added && newBlock == nullptr))
+	{
+		free(table);
+		free(newBlock);
+		return false;
+	}
+	CExceptionContext* newContexts = (CExceptionContext*)(((uintptr_t)newBlock + CEXCEPTION_CACHE_LINE - 1) & ~(uintptr_t)(CEXCEPTION_CACHE_LINE - 1));
+	for(unsigned int i = 0; i < added; i++)
+		new (&newContexts[i]) CExceptionContext();
 
+	//keep lock-free registry writers out while the index is copied
+	CExceptionTableResizing.store(true);
+	while(CExceptionRegistryWriters.load() != 0)
+		delay(1);
+
+	table->size = num;
+	table->retiredNext = nullptr;
+	table->contexts = (CExceptionContext**)(table + 1);
+	table->indexMask = indexSize - 1;
+	table->indexTombstones = 0;
+	table->indexKeys = (std::atomic<void*>*)(table->contexts + num);
+	table->indexSlots = (volatile unsigned int*)(table->indexKeys + indexSize);
+	for(unsigned int i = 0; i < indexSize; i++)
+		table->indexKeys[i].store(nullptr, std::memory_order_relaxed);
+	for(unsigned int i = 0; i < current->size; i++)
+	{
+		table->contexts[i] = current->contexts[i];
+		if(i && table->contexts[i]->info.handle)
+			__cexception_index_insert(table, table->contexts[i]->info.handle, i);
+	}
+	for(unsigned int i = 0; i < added; i++)
+		table->contexts[current->size + i] = &newContexts[i];
+
+	CExceptionActiveTable.store(table);
+	//push in reverse so the lowest new slot is handed out first
+	for(unsigned int i = num; i-- > current->size;)
+		__cexception_push_free_slot(table, i);
+	CExceptionTableResizing.store(false);
+
+	if(current != &DefaultTable)
+	{
+		current->retiredNext = CExceptionRetiredTables;
+		CExceptionRetiredTables = current;
+		CExceptionRetiredFlipped = false;
+	}
+	__cexception_reclaim_tables();
+	CExceptionReclaimPending.store(CExceptionRetiredTables != nullptr);
+	return true;
+}
+#else
+//single-task build: one frame, referenced directly by Try and Throw
+volatile CEXCEPTION_FRAME_T __cexception_frame;
+static volatile CExceptionThreadInfo CExceptionSingleThreadInfo;
+#if CEXCEPTION_METRICS
+static CExceptionMetricsState CExceptionSingleMetrics;
+#endif
+#endif
+
+#if CEXCEPTION_METRICS
+//Throws per id: open addressing on the id, entries are claimed by CAS and never released. Keys are stored
+//XORed with CEXCEPTION_NONE (never counted) so that the zero-initialised table is empty.
+static std::atomic<uint32_t> CExceptionMetricsIdKeys[CEXCEPTION_METRICS_IDS];
+static std::atomic<uint32_t> CExceptionMetricsIdThrows[CEXCEPTION_METRICS_IDS];
+static std::atomic<uint32_t> CExceptionMetricsOtherIds(0);
+
+static inline CExceptionMetricsState* __cexception_frame_metrics(volatile CEXCEPTION_FRAME_T* frame) {
+#if CEXCEPTION_MULTI_TASK
+	//the frame is the first member of its context
+	return &((CExceptionContext*)frame)->metrics;
+#else
+	return &CExceptionSingleMetrics;
+#endif
+}
 
+static void __cexception_metrics_throw(volatile CEXCEPTION_FRAME_T* frame, CEXCEPTION_T ExceptionID) {
+	CExceptionMetricsState* m = __cexception_frame_metrics(frame);
+	m->throws = m->throws + 1;
+	m->throwTime = (uint32_t)micros();
+
+	uint32_t key = (uint32_t)(ExceptionID ^ CEXCEPTION_NONE);
+	unsigned int i = (unsigned int)((key * 2654435769u) >> 16) & (CEXCEPTION_METRICS_IDS - 1);
+	for(unsigned int probes = 0; probes < CEXCEPTION_METRICS_IDS; probes++, i = (i + 1) & (CEXCEPTION_METRICS_IDS - 1))
+	{
+		uint32_t k = CExceptionMetricsIdKeys[i].load(std::memory_order_relaxed);
+		if(k == 0 && CExceptionMetricsIdKeys[i].compare_exchange_strong(k, key, std::memory_order_relaxed))
+			k = key;
+		if(k == key)
+		{
+			CExceptionMetricsIdThrows[i].fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+	CExceptionMetricsOtherIds.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void __cexception_metrics_catch(volatile CEXCEPTION_FRAME_T* frame, CEXCEPTION_T e) {
+	if(e == CEXCEPTION_NONE) //ExitTry
+		return;
+	CExceptionMetricsState* m = __cexception_frame_metrics(frame);
+	m->catches = m->catches + 1;
+	uint32_t latency = (uint32_t)micros() - m->throwTime;
+	unsigned int bucket = latency ? 32 - __builtin_clz(latency) : 0;
+	if(bucket >= CEXCEPTION_METRICS_LATENCY_BUCKETS)
+		bucket = CEXCEPTION_METRICS_LATENCY_BUCKETS - 1;
+	m->latency[bucket] = m->latency[bucket] + 1;
+}
+
+static void __cexception_read_metrics(volatile CEXCEPTION_FRAME_T* frame, CExceptionThreadMetrics* out) {
+	CExceptionMetricsState* m = __cexception_frame_metrics(frame);
+	out->tries = frame->Tries;
+	out->throws = m->throws;
+	out->catches = m->catches;
+	for(unsigned int b = 0; b < CEXCEPTION_METRICS_LATENCY_BUCKETS; b++)
+		out->latency[b] = m->latency[b];
+}
+
+static void __cexception_add_metrics(CExceptionThreadMetrics* total, const CExceptionThreadMetrics* add) {
+	total->tries += add->tries;
+	total->throws += add->throws;
+	total->catches += add->catches;
+	for(unsigned int b = 0; b < CEXCEPTION_METRICS_LATENCY_BUCKETS; b++)
+		total->latency[b] += add->latency[b];
+}
+
+#if CEXCEPTION_MULTI_TASK
+//counts of threads whose slot has since been reused, updated with atomic adds so registration stays lock-free
+static CExceptionThreadMetrics CExceptionRetiredMetrics;
+
+static void __cexception_retire_metrics(CExceptionContext* context) {
+	static_assert(sizeof(CExceptionThreadMetrics) % sizeof(uint32_t) == 0, "CExceptionThreadMetrics must be all uint32_t");
+	CExceptionThreadMetrics previous;
+	__cexception_read_metrics(&context->frame, &previous);
+	uint32_t* from = (uint32_t*)&previous;
+	uint32_t* to = (uint32_t*)&CExceptionRetiredMetrics;
+	for(unsigned int i = 0; i < sizeof(previous) / sizeof(uint32_t); i++)
+		__atomic_fetch_add(&to[i], from[i], __ATOMIC_RELAXED);
+	context->frame.Tries = 0;
+	memset((void*)&context->metrics, 0, sizeof(context->metrics));
+}
+#endif
+
+extern "C" void __cexception_metrics_snapshot(CExceptionMetricsSnapshot* snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->timestamp = millis();
+	CExceptionThreadMetrics thread;
+#if CEXCEPTION_MULTI_TASK
+	uint32_t* retired = (uint32_t*)&CExceptionRetiredMetrics;
+	uint32_t* total = (uint32_t*)&snapshot->total;
+	for(unsigned int i = 0; i < sizeof(CExceptionThreadMetrics) / sizeof(uint32_t); i++)
+		total[i] = __atomic_load_n(&retired[i], __ATOMIC_RELAXED);
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	for(unsigned int i = 0; i < table->size; i++)
+	{
+		__cexception_read_metrics(&table->contexts[i]->frame, &thread);
+		__cexception_add_metrics(&snapshot->total, &thread);
+		if(i && table->contexts[i]->info.handle)
+			snapshot->threads++;
+	}
+	__cexception_read_unlock(epoch);
+#else
+	__cexception_read_metrics(&__cexception_frame, &thread);
+	__cexception_add_metrics(&snapshot->total, &thread);
+#endif
+
+	for(unsigned int i = 0; i < CEXCEPTION_METRICS_IDS; i++)
+	{
+		uint32_t key = CExceptionMetricsIdKeys[i].load(std::memory_order_relaxed);
+		snapshot->ids[i].id = key ? (CEXCEPTION_T)(key ^ CEXCEPTION_NONE) : CEXCEPTION_NONE;
+		snapshot->ids[i].throws = CExceptionMetricsIdThrows[i].load(std::memory_order_relaxed);
+	}
+	snapshot->otherIdThrows = CExceptionMetricsOtherIds.load(std::memory_order_relaxed);
+}
+
+extern "C" bool __cexception_thread_metrics(unsigned int id, CExceptionThreadMetrics* metrics) {
+#if CEXCEPTION_MULTI_TASK
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	bool found = id < table->size;
+	if(found)
+		__cexception_read_metrics(&table->contexts[id]->frame, metrics);
+	__cexception_read_unlock(epoch);
+	return found;
+#else
+	if(id != 0)
+		return false;
+	__cexception_read_metrics(&__cexception_frame, metrics);
+	return true;
+#endif
+}
+#endif
+
+#ifndef CEXCEPTION_PLATFORM_HOST
 void* __cexception_get_bl_target(void* func, uint32_t idx) {
 	//verify the source function is thumb
 	if((uint32_t)func & 0x00000001)
@@ -61,24 +507,114 @@ os_thread_t __cexception_get_current_thread_handle() {
 extern "C" __attribute__((weak)) os_thread_t __gthread_self() {
 	return __cexception_get_current_thread_handle();
 }
+#else
+os_thread_t __cexception_get_current_thread_handle() {
+	return os_thread_current();
+}
+#endif
+
+#if CEXCEPTION_MULTI_TASK
+struct CExceptionSlotRef {
+	unsigned int id;
+	CExceptionContext* context;
+};
 
-static unsigned int __cexception_get_current_task_number_internal() {
-	unsigned int found = 0;
-	for(unsigned int i = 1; i < CException_Num_Tasks && !found; i++)
+#if CEXCEPTION_ID_PROVIDER != CEXCEPTION_ID_HASH
+static CExceptionSlotRef __cexception_scan_current_slot() {
+	CExceptionSlotRef ref = { 0, &DefaultCExceptionContext };
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	for(unsigned int i = 1; i < table->size; i++)
 	{
-		if(os_thread_is_current(TaskIds[i].handle)) {
-			found = i;
+		if(os_thread_is_current(table->contexts[i]->info.handle)) {
+			ref.id = i;
+			ref.context = table->contexts[i];
+			break;
 		}
 	}
-	return found;
+	__cexception_read_unlock(epoch);
+	return ref;
+}
+#endif
+
+#if CEXCEPTION_ID_PROVIDER == CEXCEPTION_ID_TLS
+//Per-thread cache of the registry slot. A cached slot is trusted only while the registry entry still belongs
+//to the current thread (one os_thread_is_current() call instead of one per slot). A miss is cached too, tagged
+//with the registry generation, so unregistered threads (e.g. the main loop) do not rescan on every Try/Throw.
+static __thread CExceptionSlotRef CExceptionTlsSlot = { 0, nullptr };
+static __thread unsigned int CExceptionTlsGeneration = 0;
+static std::atomic<unsigned int> CExceptionRegistryGeneration(1);
+
+static inline const CExceptionSlotRef& __cexception_current_slot() {
+	CExceptionSlotRef& slot = CExceptionTlsSlot;
+	if(slot.id && os_thread_is_current(slot.context->info.handle))
+		return slot;
+	unsigned int generation = CExceptionRegistryGeneration;
+	if(!slot.id && slot.context && CExceptionTlsGeneration == generation)
+		return slot;
+
+	slot = __cexception_scan_current_slot();
+	CExceptionTlsGeneration = generation;
+	return slot;
+}
+#elif CEXCEPTION_ID_PROVIDER == CEXCEPTION_ID_HASH
+//Resolve the current thread's handle through the registry's hash index on every call. The read-side section
+//around the lookup is two atomic updates of a reader counter that every thread shares.
+static inline CExceptionSlotRef __cexception_current_slot() {
+	void* handle = __cexception_get_current_thread_handle();
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	unsigned int id = __cexception_index_find(table, handle);
+	CExceptionSlotRef ref = { id, table->contexts[id] };
+	__cexception_read_unlock(epoch);
+	return ref;
+}
+#else
+#define __cexception_current_slot __cexception_scan_current_slot
+#endif
+
+static inline volatile CExceptionThreadInfo* __cexception_current_info() {
+	return &__cexception_current_slot().context->info;
+}
+
+static inline unsigned int __cexception_get_current_task_number_internal() {
+	return __cexception_current_slot().id;
+}
+
+extern "C" volatile CEXCEPTION_FRAME_T* __cexception_get_current_frame() {
+	return &__cexception_current_slot().context->frame;
+}
+
+extern "C" volatile CEXCEPTION_FRAME_T* __cexception_get_frame(unsigned int id) {
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	volatile CEXCEPTION_FRAME_T* frame = id < table->size ? &table->contexts[id]->frame : nullptr;
+	__cexception_read_unlock(epoch);
+	return frame;
+}
+#else
+static inline volatile CExceptionThreadInfo* __cexception_current_info() {
+	return &CExceptionSingleThreadInfo;
 }
 
+extern "C" volatile CEXCEPTION_FRAME_T* __cexception_get_current_frame() {
+	return &__cexception_frame;
+}
+
+extern "C" volatile CEXCEPTION_FRAME_T* __cexception_get_frame(unsigned int id) {
+	return id == 0 ? &__cexception_frame : nullptr;
+}
+#endif
+
 extern "C" const char* __cexception_get_current_thread_name() {
 	return __cexception_get_thread_name(__cexception_get_current_thread_handle());
 }
 
 extern "C" const char* __cexception_get_thread_name(const void* threadHandle)
 {
+#ifdef CEXCEPTION_PLATFORM_HOST
+	return os_thread_name((os_thread_t)threadHandle);
+#else
 	const char* name = (const char*)((uint32_t)__gthread_self() + 0x34);
 //	int i;
 //	for(i = 0; i < 20; i++)
@@ -92,97 +628,276 @@ extern "C" const char* __cexception_get_thread_name(const void* threadHandle)
 		return name;
 	else
 		return "NO NAME";
+#endif
 }
 
 uint32_t* __cexception_get_current_thread_exception_data() {
-	return (uint32_t*)&TaskIds[__cexception_get_current_task_number_internal()].exceptionData;
+	return (uint32_t*)__cexception_current_info()->exceptionData;
 }
 
-static void dump_thread_list(unsigned int idToHighlight) {
-	uint32_t lastPrinted = 0;
+CExceptionThreadInfo* __cexception_get_current_thread_info() {
+	return (CExceptionThreadInfo*)__cexception_current_info();
+}
+
+#if CEXCEPTION_MULTI_TASK
+//read lock held; threads in handle order, marking handleToHighlight and leaving out handleToSkip
+static void __cexception_dump_threads(CExceptionTable* table, uintptr_t handleToHighlight, uintptr_t handleToSkip) {
+	uintptr_t lastPrinted = 0;
 	for(;;)
 	{
-		uint32_t nextPrinted = UINT32_MAX;
+		uintptr_t nextPrinted = UINTPTR_MAX;
 		uint32_t nextIndex = 0;
-		for(unsigned int i = 0; i < CException_Num_Tasks; i++)
+		for(unsigned int i = 0; i < table->size; i++)
 		{
-			uint32_t handle = (uint32_t)(TaskIds[i].handle);
+			uintptr_t handle = (uintptr_t)(table->contexts[i]->info.handle);
 			if(handle > lastPrinted && handle < nextPrinted)
 			{
 				nextPrinted = handle;
 				nextIndex = i;
 			}
 		}
-		if(lastPrinted == nextPrinted || nextPrinted == UINT32_MAX)
+		if(lastPrinted == nextPrinted || nextPrinted == UINTPTR_MAX)
 			break;
 		else {
-			LOG(INFO, " Thread %u: %-15s @ 0x%08x%s", nextIndex, __cexception_get_thread_name(TaskIds[nextIndex].handle), TaskIds[nextIndex].handle, nextIndex == idToHighlight ? " <<<<" : "");
+			if(nextPrinted != handleToSkip)
+				LOG(INFO, " Thread %u: %-15s @ 0x%08lx%s", (unsigned int)nextIndex, __cexception_get_thread_name((void*)nextPrinted), (unsigned long)nextPrinted, nextPrinted == handleToHighlight ? " <<<<" : "");
 			lastPrinted = nextPrinted;
 		}
 	}
 }
 
-unsigned int __cexception_get_number_of_threads() { return CException_Num_Tasks; }
-unsigned int __cexception_get_active_thread_count() {
+extern "C" void __cexception_dump_thread_list(unsigned int idToHighlight) {
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	uintptr_t handle = idToHighlight < table->size ? (uintptr_t)table->contexts[idToHighlight]->info.handle : 0;
+	__cexception_dump_threads(table, handle, 0);
+	__cexception_read_unlock(epoch);
+}
+
+extern "C" void __cexception_dump_other_threads(const void* threadHandle) {
+	unsigned int epoch = __cexception_read_lock();
+	__cexception_dump_threads(CExceptionActiveTable.load(), 0, (uintptr_t)threadHandle);
+	__cexception_read_unlock(epoch);
+}
+
+#if CEXCEPTION_STACK_USAGE
+//Stack high-water marks. The thread wrapper fills the unused part of the thread's stack with a pattern; the
+//lowest word that no longer holds it marks the deepest the stack has been. Reading another thread's stack is
+//a plain scan: a report that races with the thread ending may read memory the platform is about to release.
+static const uint32_t CEXCEPTION_STACK_PAINT = 0xA5A5A5A5;
+//bytes left unpainted below the painter's frame (red zone, its own calls)
+static const uintptr_t CEXCEPTION_STACK_PAINT_MARGIN = 512;
+
+static void __attribute__((noinline)) __cexception_paint_stack(CExceptionContext* context) {
+	void* low;
+	size_t size;
+	if(!os_thread_current_stack(&low, &size))
+		return;
+	uint32_t* p = (uint32_t*)(((uintptr_t)low + 3) & ~(uintptr_t)3);
+	uint32_t* limit = (uint32_t*)(((uintptr_t)__builtin_frame_address(0) - CEXCEPTION_STACK_PAINT_MARGIN) & ~(uintptr_t)3);
+	for(; p < limit; p++)
+		*(volatile uint32_t*)p = CEXCEPTION_STACK_PAINT;
+	context->stackSize = (uint32_t)size;
+	context->stackLow = (uint32_t*)(((uintptr_t)low + 3) & ~(uintptr_t)3);
+}
+
+static void __cexception_measure_stack(CExceptionContext* context) {
+	const volatile uint32_t* p = context->stackLow;
+	if(p == nullptr)
+		return;
+	const volatile uint32_t* high = (const volatile uint32_t*)((uintptr_t)p + context->stackSize);
+	while(p < high && *p == CEXCEPTION_STACK_PAINT)
+		p++;
+	uint32_t peak = (uint32_t)((uintptr_t)high - (uintptr_t)p);
+	if(peak > context->stackPeak)
+		context->stackPeak = peak;
+}
+
+//read lock held
+static bool __cexception_read_stack_usage(CExceptionContext* context, unsigned int id, CExceptionStackUsage* usage) {
+	void* handle = context->info.handle;
+	if(handle == nullptr && context->stackSize == 0)
+		return false;
+	if(handle)
+		__cexception_measure_stack(context);
+	usage->id = id;
+	usage->handle = handle;
+	usage->stackSize = context->stackSize;
+	usage->stackPeak = context->stackPeak;
+	usage->tryDepthMax = context->frame.TryDepthMax;
+	usage->jmpBufBytes = usage->tryDepthMax * (uint32_t)sizeof(CEXCEPTION_JMP_BUF);
+	return true;
+}
+
+extern "C" unsigned int __cexception_stack_usage(CExceptionStackUsage* usage, unsigned int max) {
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
 	unsigned int count = 0;
-	for(unsigned int i = 1; i < CException_Num_Tasks; i++)
+	CExceptionStackUsage entry;
+	for(unsigned int i = 1; i < table->size; i++)
 	{
-		if(TaskIds[i].handle)
-			count++;
+		if(!__cexception_read_stack_usage(table->contexts[i], i, &entry))
+			continue;
+		if(count < max)
+			usage[count] = entry;
+		count++;
 	}
+	__cexception_read_unlock(epoch);
 	return count;
 }
 
+extern "C" void __cexception_dump_stack_usage() {
+	unsigned int epoch = __cexception_read_lock();
+	CExceptionTable* table = CExceptionActiveTable.load();
+	CExceptionStackUsage entry;
+	for(unsigned int i = 1; i < table->size; i++)
+	{
+		if(!__cexception_read_stack_usage(table->contexts[i], i, &entry))
+			continue;
+		LOG(INFO, " Thread %u: %-15s stack %lu of %lu bytes, Try depth %u (%lu bytes of jmp_buf)", i,
+				entry.handle ? __cexception_get_thread_name(entry.handle) : "(ended)", (unsigned long)entry.stackPeak,
+				(unsigned long)entry.stackSize, (unsigned int)entry.tryDepthMax, (unsigned long)entry.jmpBufBytes);
+	}
+	__cexception_read_unlock(epoch);
+}
+#endif
+
+unsigned int __cexception_get_number_of_threads() { return CExceptionActiveTable.load()->size; }
+unsigned int __cexception_get_active_thread_count() {
+	return CExceptionActiveThreads.load();
+}
+
 extern "C" void __cexception_set_number_of_threads(unsigned int num) {
 	BEGIN_LOCK_SAFE(taskLock)
 	{
-		if(num <= CException_Num_Tasks)
+		if(num <= CExceptionActiveTable.load()->size)
 			Throw(EXCEPTION_INVALID_ARGUMENT);
 
-		CEXCEPTION_FRAME_T* newFrames = (CEXCEPTION_FRAME_T*)malloc(num*sizeof(CEXCEPTION_FRAME_T));
-		CExceptionThreadInfo* newTaskList = (CExceptionThreadInfo*)malloc((num)*sizeof(CExceptionThreadInfo));
-		if(newFrames == nullptr || newTaskList == nullptr)
-		{
-			if(newFrames)
-				free(newFrames);
-			if(newTaskList)
-				free(newTaskList);
-
+		if(!__cexception_grow_table(num))
 			Throw(EXCEPTION_OUT_OF_MEM);
-		}
+	} END_LOCK_SAFE();
+}
 
-		memset(newFrames, 0, (num)*sizeof(CEXCEPTION_FRAME_T));
-		memcpy(newFrames, (void*)CExceptionFrames, CException_Num_Tasks * sizeof(CEXCEPTION_FRAME_T));
+static inline bool __cexception_index_needs_purge(CExceptionTable* table) {
+	return table->indexTombstones > (table->indexMask + 1) / 4;
+}
 
-		memset(newTaskList, 0, (num)*sizeof(CExceptionThreadInfo));
-		if(CException_Num_Tasks > 1)
-			memcpy(newTaskList, (void*)TaskIds, (CException_Num_Tasks)*sizeof(CExceptionThreadInfo));
+//Housekeeping that needs taskLock: rebuild the index once tombstones make up a quarter of it, and free retired
+//tables. Failure to allocate is harmless, lookups stay correct, just longer.
+static void __cexception_registry_maintenance() {
+	std::lock_guard<decltype(taskLock)> lck(taskLock);
+	CExceptionTable* table = CExceptionActiveTable.load();
+	if(__cexception_index_needs_purge(table))
+		__cexception_grow_table(table->size);
+	__cexception_reclaim_tables();
+	CExceptionReclaimPending.store(CExceptionRetiredTables != nullptr);
+}
 
-		CExceptionFrames = newFrames;
-		TaskIds = newTaskList;
-		CException_Num_Tasks = num;
-	} END_LOCK_SAFE();
+//give threadHandle a free slot (registry writer or taskLock); returns 0 if none is free
+static unsigned int __cexception_claim_slot(CExceptionTable* table, void* threadHandle, void(*exceptionCallback)(CEXCEPTION_T,CExceptionThreadInfo*)) {
+	unsigned int slot = __cexception_pop_free_slot(table);
+	if(slot)
+	{
+		volatile CExceptionThreadInfo* info = &table->contexts[slot]->info;
+#if CEXCEPTION_METRICS
+		__cexception_retire_metrics(table->contexts[slot]);
+#endif
+#if CEXCEPTION_ARENA_SIZE
+		//memory a previous owner allocated outside any Try
+		table->contexts[slot]->frame.ArenaTop = 0;
+#endif
+		table->contexts[slot]->frame.Cleanups = nullptr;
+		table->contexts[slot]->frame.Filters = nullptr;
+#if CEXCEPTION_STACK_USAGE
+		table->contexts[slot]->frame.TryDepth = 0;
+		table->contexts[slot]->frame.TryDepthMax = 0;
+		table->contexts[slot]->stackLow = nullptr;
+		table->contexts[slot]->stackSize = 0;
+		table->contexts[slot]->stackPeak = 0;
+#endif
+		info->exceptionCallback = exceptionCallback;
+		info->handle = threadHandle;
+		__cexception_index_insert(table, threadHandle, slot);
+		CExceptionActiveThreads.fetch_add(1);
+#if CEXCEPTION_ID_PROVIDER == CEXCEPTION_ID_TLS
+		//invalidate cached "not registered" lookups
+		CExceptionRegistryGeneration.fetch_add(1);
+#endif
+	}
+	return slot;
 }
 
-unsigned int __cexception_register_thread_internal(void* threadHandle, const char* name, void(*exceptionCallback)(CEXCEPTION_T,CExceptionThreadInfo*))
-{
-	for(unsigned int i = 1; i < CException_Num_Tasks; i++)
+//free the slot if it still belongs to threadHandle (registry writer or taskLock). The handle is cleared with a
+//CAS so that concurrent unregisters of the same thread release the slot only once.
+static void __cexception_release_slot(CExceptionTable* table, unsigned int slot, void* threadHandle) {
+	void* expected = threadHandle;
+	if(__atomic_compare_exchange_n((void**)&table->contexts[slot]->info.handle, &expected, nullptr, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
 	{
-		if(TaskIds[i].handle == nullptr)
-		{
-			TaskIds[i].handle = threadHandle;
-			TaskIds[i].exceptionCallback = exceptionCallback;
-			return i;
-		}
+#if CEXCEPTION_STACK_USAGE
+		//last look while the thread is still on its stack
+		__cexception_measure_stack(table->contexts[slot]);
+#endif
+		__cexception_index_remove(table, threadHandle);
+#if CEXCEPTION_STACK_ARENA
+		__cexception_stack_retire(threadHandle);
+#endif
+		__cexception_push_free_slot(table, slot);
+		CExceptionActiveThreads.fetch_sub(1);
+	}
+}
 
+//The purge check is made before leaving the writer section or taskLock: past that point the table may be
+//retired and freed by a grow or index rebuild on another thread, and this thread is not an epoch reader.
+static void __cexception_unregister_slot(unsigned int slot, void* threadHandle) {
+	bool purge;
+	if(__cexception_enter_registry_writer())
+	{
+		CExceptionTable* table = CExceptionActiveTable.load();
+		__cexception_release_slot(table, slot, threadHandle);
+		purge = __cexception_index_needs_purge(table);
+		__cexception_exit_registry_writer();
+	}
+	else
+	{
+		std::lock_guard<decltype(taskLock)> lck(taskLock);
+		CExceptionTable* table = CExceptionActiveTable.load();
+		__cexception_release_slot(table, slot, threadHandle);
+		purge = __cexception_index_needs_purge(table);
 	}
 
-	Throw(EXCEPTION_OUT_OF_MEM);
-	return UINT32_MAX;
+	if(purge || CExceptionReclaimPending.load())
+		__cexception_registry_maintenance();
+}
+
+extern "C" __attribute__((weak)) void __cexception_registration_hook() {
+}
+
+//taskLock must be held. Grows the table (doubling) when every slot is taken.
+unsigned int __cexception_register_thread_internal(void* threadHandle, const char* name, void(*exceptionCallback)(CEXCEPTION_T,CExceptionThreadInfo*))
+{
+	unsigned int slot;
+	while((slot = __cexception_claim_slot(CExceptionActiveTable.load(), threadHandle, exceptionCallback)) == 0)
+	{
+		unsigned int size = CExceptionActiveTable.load()->size;
+		if(!__cexception_grow_table(size < 4 ? 4 : size * 2))
+			Throw(EXCEPTION_OUT_OF_MEM);
+	}
+	return slot;
 }
 
 extern "C" unsigned int __cexception_register_thread(void* threadHandle, const char* name, void(*exceptionCallback)(CEXCEPTION_T,CExceptionThreadInfo*))
 {
+	if(threadHandle == __cexception_get_current_thread_handle())
+		__cexception_backtrace_thread_start();
+	if(__cexception_enter_registry_writer())
+	{
+		unsigned int slot = __cexception_claim_slot(CExceptionActiveTable.load(), threadHandle, exceptionCallback);
+		__cexception_exit_registry_writer();
+		if(slot)
+			return slot;
+	}
+
+	//table is full (or being republished)
 	BEGIN_LOCK_SAFE(taskLock)
 	{
 		return __cexception_register_thread_internal(threadHandle, name, exceptionCallback);
@@ -190,25 +905,26 @@ extern "C" unsigned int __cexception_register_thread(void* threadHandle, const c
 }
 
 extern "C" void __cexception_unregister_current_thread() {
-	BEGIN_LOCK_SAFE(taskLock)
-	{
-		unsigned int taskNumber = __cexception_get_current_task_number_internal();
-		LOG(INFO, "Unregistering thread %d (%s @ 0x%08x)", taskNumber, __cexception_get_thread_name(TaskIds[taskNumber].handle), TaskIds[taskNumber].handle);
-
-		TaskIds[taskNumber].handle = nullptr;
-	} END_LOCK_SAFE();
+	CExceptionSlotRef slot = __cexception_current_slot();
+	void* handle = slot.context->info.handle;
+	LOG(INFO, "Unregistering thread %u (%s @ 0x%08lx)", slot.id, __cexception_get_thread_name(handle), (unsigned long)(uintptr_t)handle);
+
+	if(slot.id)
+		__cexception_unregister_slot(slot.id, handle);
+#if CEXCEPTION_ID_PROVIDER == CEXCEPTION_ID_TLS
+	CExceptionTlsSlot.id = 0;
+	CExceptionTlsSlot.context = &DefaultCExceptionContext;
+#endif
 }
 
 extern "C" void __cexception_unregister_thread(void* threadHandle) {
 	if(threadHandle)
 	{
-		BEGIN_LOCK_SAFE(taskLock)
-		{
-			unsigned int taskNumber = __cexception_get_task_number(threadHandle);
-			LOG(INFO, "Unregistering thread %d (%s @ 0x%08x)", taskNumber, __cexception_get_thread_name(TaskIds[taskNumber].handle), TaskIds[taskNumber].handle);
+		unsigned int taskNumber = __cexception_get_task_number(threadHandle);
+		LOG(INFO, "Unregistering thread %u (%s @ 0x%08lx)", taskNumber, __cexception_get_thread_name(threadHandle), (unsigned long)(uintptr_t)threadHandle);
 
-			TaskIds[taskNumber].handle = nullptr;
-		} END_LOCK_SAFE();
+		if(taskNumber)
+			__cexception_unregister_slot(taskNumber, threadHandle);
 	}
 	else
 		__cexception_unregister_current_thread();
@@ -216,13 +932,9 @@ extern "C" void __cexception_unregister_thread(void* threadHandle) {
 
 
 extern "C" unsigned int __cexception_get_task_number(void* threadHandle) {
-	unsigned int found = 0;
-	for(unsigned int i = 1; i < CException_Num_Tasks && !found; i++)
-	{
-		if(threadHandle == TaskIds[i].handle) {
-			found = i;
-		}
-	}
+	unsigned int epoch = __cexception_read_lock();
+	unsigned int found = __cexception_index_find(CExceptionActiveTable.load(), threadHandle);
+	__cexception_read_unlock(epoch);
 
 //	LOG(TRACE, "Found id %d", found);
 
@@ -237,6 +949,7 @@ extern "C" unsigned int __cexception_get_current_task_number() {
 		LOG_DEBUG(TRACE, "Thread not registered, using default frame");
 	return found;
 }
+#endif
 
 
 __attribute__((weak)) bool __cexception_internal_global_handler(CEXCEPTION_T e) {
@@ -249,62 +962,46 @@ extern "C" __attribute__((weak)) void CException_Global_Handler(CEXCEPTION_T Exc
 
 	LOG(ERROR, "Unhandled exception 0x%08x", ExceptionID);
 	if(__cexception_internal_global_handler(ExceptionID)) {
-		LOG(ERROR, "Halting application", ExceptionID);
+		LOG(ERROR, "Halting application");
 		delay(100); //give the message a chance to bubble out
 		unsigned int panicCode = ExceptionID < 15 ? ExceptionID : HardFault;
 		panic_((ePanicCode)panicCode, nullptr, HAL_Delay_Microseconds);
 	}
 }
 
-struct CEXCEPTION_THREAD_FUNC_T {
-	void (*func)(void*);
-	void* arg;
-};
-
-#include "system_threading.h"
-void* system_internal(int item, void* reserved);
-#define INVOKE_ASYNC(threadp, lambda) do { auto __lambda = lambda; if(threadp != nullptr && threadp->isStarted() && !threadp->isCurrentThread()) threadp->invoke_async(FFL(__lambda)); else __lambda(); } while(0)
-ActiveObjectThreadQueue* CExceptionLoggingThread = nullptr;
-//	CExceptionLoggingThread = ((ActiveObjectThreadQueue*)system_internal(1, nullptr));
-
-static void __cexception_thread_wrapper(void * arg) {
+#if CEXCEPTION_MULTI_TASK
+static void __cexception_thread_wrapper(void*) {
 	//wait until the lock is free--this will give the thread launcher a chance to register the thread,
 	//even if this thread is a higher priority.
-	//TODO: figure out what along this execution path forces the stack to be large
+	//TODO: figure out what along this execution path forces the stack to be large (CEXCEPTION_STACK_USAGE
+	//reports what each thread actually used)
 	{ std::lock_guard<decltype(taskLock)> lck(taskLock); }
-
-	unsigned int myId = __cexception_get_current_task_number_internal();
-	const char* name =__cexception_get_thread_name(TaskIds[myId].handle);
-
-	INVOKE_ASYNC(CExceptionLoggingThread, [&]()
-	{
-		LOG(INFO, "Thread %d (%s @ 0x%08x) started", myId, name, TaskIds[myId].handle);
-	});
-
+	__cexception_backtrace_thread_start();
+
+	CExceptionSlotRef slot = __cexception_current_slot();
+	volatile CExceptionThreadInfo* myInfo = &slot.context->info;
+#if CEXCEPTION_STACK_USAGE
+	if(slot.id)
+		__cexception_paint_stack(slot.context);
+#endif
+	void (*func)(void*) = slot.context->launchFunc;
+	void* arg = slot.context->launchArg;
+	slot.context->launchFunc = nullptr;
+	//registration failed and the launcher has thrown; the default context has no launch
+	if(!func)
+		END_THREAD();
+	__cexception_post_event(CEXCEPTION_EVENT_THREAD_STARTED, CEXCEPTION_NONE, nullptr);
 
 	CEXCEPTION_T e;
-	CEXCEPTION_THREAD_FUNC_T* tip = ((CEXCEPTION_THREAD_FUNC_T*) arg);
-	CEXCEPTION_THREAD_FUNC_T threadInfo = *tip;
-	free(tip);
-
 	Try	{
-		threadInfo.func(threadInfo.arg);
+		func(arg);
 	} Catch(e) {
-		volatile bool done = 1;
-
-		INVOKE_ASYNC(CExceptionLoggingThread, [&]()
-		{
-			if(TaskIds[myId].exceptionCallback)
-				TaskIds[myId].exceptionCallback(e, (CExceptionThreadInfo*)&TaskIds[myId]);
-			LOG(ERROR, "Exception 0x%08x not handled in thread %d (%s @ 0x%08x).", e, myId, name, TaskIds[myId].handle);
-			LOG(ERROR, "Thread %d terminated. **WARNING: dynamic or external resources are not cleaned up**", myId);
-
-			dump_thread_list(myId);
-			done = true;
-		});
-
-		while(!done) delay(10);
-		delay(1);
+		//the callback still runs here, while the thread info it is given is valid; the log is written by the
+		//event reporter
+		if(myInfo->exceptionCallback)
+			myInfo->exceptionCallback(e, (CExceptionThreadInfo*)myInfo);
+		__cexception_trace(CEXCEPTION_TRACE_THREAD_DIED, e, nullptr, nullptr, 0);
+		__cexception_post_event(CEXCEPTION_EVENT_THREAD_DIED, e, nullptr);
 	}
 
 	END_THREAD(); //if user ends thread, this will never get called #notaproblem
@@ -313,52 +1010,69 @@ static void __cexception_thread_wrapper(void * arg) {
 extern "C" void __cexception_thread_create(void** thread, const char* name, unsigned int priority,
 		void(*fun)(void*), void* thread_param, unsigned int stack_size, void(*exceptionCallback)(CEXCEPTION_T, CExceptionThreadInfo*))
 {
-	if(__cexception_get_active_thread_count() >= (CException_Num_Tasks - 1))
+	if(__cexception_get_active_thread_count() >= (__cexception_get_number_of_threads() - 1))
 		Throw(EXCEPTION_TOO_MANY_THREADS);
+	__cexception_start_event_reporter();
 
 	void** thp = thread;
 	void* th;
 	thp = thp ? thp : &th;
-	CEXCEPTION_THREAD_FUNC_T *ti = (CEXCEPTION_THREAD_FUNC_T*) malloc(sizeof(CEXCEPTION_THREAD_FUNC_T));
-	if (!ti)
-		Throw(EXCEPTION_OUT_OF_MEM);
-
-	ti->func = fun;
-	ti->arg = thread_param;
-
 
 	BEGIN_LOCK_SAFE(taskLock)
 	{
-		os_thread_create(thp, name, priority, __cexception_thread_wrapper, ti, stack_size+256);
+#if CEXCEPTION_STACK_ARENA
+		uint32_t blockSize;
+		void* stack = __cexception_stack_acquire(stack_size+CEXCEPTION_THREAD_STACK_EXTRA, &blockSize);
+		if (stack)
+			os_thread_create_with_stack(thp, name, priority, __cexception_thread_wrapper, nullptr, stack, blockSize);
+		else
+#endif
+		os_thread_create(thp, name, priority, __cexception_thread_wrapper, nullptr, stack_size+CEXCEPTION_THREAD_STACK_EXTRA);
 
 		if (*thp == nullptr)
 		{
-			free(ti);
+#if CEXCEPTION_STACK_ARENA
+			if (stack)
+				__cexception_stack_release(stack);
+#endif
 			Throw(EXCEPTION_THREAD_START_FAILED);
 		}
-
-		__cexception_register_thread_internal(*thp, name, exceptionCallback);
+#if CEXCEPTION_STACK_ARENA
+		if (stack)
+			__cexception_stack_started(stack, *thp);
+#endif
+
+		//if registration fails, the thread finds no launch function and ends; its stack goes back once it has
+		BEGIN_CLEANUP([&]() {
+#if CEXCEPTION_STACK_ARENA
+			if (stack)
+				__cexception_stack_retire(*thp);
+#endif
+		})
+		{
+			__cexception_registration_hook();
+			unsigned int slot = __cexception_register_thread_internal(*thp, name, exceptionCallback);
+			CExceptionContext* context = CExceptionActiveTable.load()->contexts[slot];
+			context->launchFunc = fun;
+			context->launchArg = thread_param;
+		} END_CLEANUP();
 	} END_LOCK_SAFE();
 }
+#endif
 
 volatile uint32_t __cexception_fault_stack[CEXCEPTION_DATA_COUNT];
 
+//Throw without a trace record; the fault handlers write a FAULT record instead
+static void __cexception_raise(CEXCEPTION_T ExceptionID, const void* site, const char* file, uint32_t line, const void* frame);
+
+#ifndef CEXCEPTION_PLATFORM_HOST
 extern "C" void CException_Fault_Handler() {
-	volatile uint32_t* exceptionData = TaskIds[__cexception_get_current_task_number_internal()].exceptionData;
+	volatile uint32_t* exceptionData = __cexception_current_info()->exceptionData;
 	memcpy((void *)exceptionData, (const void*)__cexception_fault_stack, sizeof(__cexception_fault_stack));
 	__asm (" cpsie if \n");
-	LOG(ERROR, "HARDWARE EXCEPTION CAUGHT");
-	LOG(ERROR, "r0   = 0x%08x", exceptionData[0]);
-	LOG(ERROR, "r1   = 0x%08x", exceptionData[1]);
-	LOG(ERROR, "r2   = 0x%08x", exceptionData[2]);
-	LOG(ERROR, "r3   = 0x%08x", exceptionData[3]);
-	LOG(ERROR, "r12  = 0x%08x", exceptionData[4]);
-	LOG(ERROR, "lr   = 0x%08x", exceptionData[5]);
-	LOG(ERROR, "pc   = 0x%08x", exceptionData[6]);
-	LOG(ERROR, "psr  = 0x%08x", exceptionData[7]);
-	LOG(ERROR, "hfsr = 0x%08x", exceptionData[8]);
-	LOG(ERROR, "cfsr = 0x%08x", exceptionData[9]);
-	Throw(EXCEPTION_HARDWARE);
+	__cexception_trace(CEXCEPTION_TRACE_FAULT, EXCEPTION_HARDWARE, (const void*)(uintptr_t)exceptionData[6], (const uint32_t*)exceptionData, CEXCEPTION_DATA_COUNT);
+	__cexception_post_event(CEXCEPTION_EVENT_FAULT, EXCEPTION_HARDWARE, (const uint32_t*)exceptionData);
+	__cexception_raise(EXCEPTION_HARDWARE, (const void*)(uintptr_t)exceptionData[6], nullptr, 0, __builtin_frame_address(0));
 }
 
 static  __attribute__( ( naked ) ) void __CException_Fault_Handler( void ) {
@@ -402,6 +1116,26 @@ static  __attribute__( ( naked ) ) void __CException_Fault_Handler( void ) {
 		" pop {r4-r11}                                              \n" //restore state - again, probably unneeded, but who knows what gcc might do
 	);
 
+#if CEXCEPTION_FAULT_EXTENDED
+	//r4-r11 and lr (EXC_RETURN) still hold the faulting code's values; r0 is its stacked frame
+	__asm (
+		" add r3, r3, #40                                           \n" //r3 = &__cexception_fault_stack[10]
+		" stm r3, {r4-r11}                                          \n" //[10..17] r4-r11
+		" str lr, [r3, #44]                                         \n" //[21] EXC_RETURN
+		" add r1, r0, #32                                           \n" //sp before the 8-word frame was stacked
+		" ldr r2, [r0, #28]                                         \n" //stacked psr
+		" tst r2, #0x200                                            \n" //psr bit 9: the core padded the frame to 8 bytes
+		" it ne                                                     \n"
+		" addne r1, r1, #4                                          \n"
+		" tst lr, #0x10                                             \n" //EXC_RETURN bit 4 clear: 18 more words of FP state
+		" it eq                                                     \n"
+		" addeq r1, r1, #72                                         \n"
+		" str r1, [r3, #32]                                         \n" //[18] sp
+	);
+	__cexception_fault_stack[19] = SCB->MMFAR;
+	__cexception_fault_stack[20] = SCB->BFAR;
+#endif
+
 	__cexception_fault_stack[8] = SCB->HFSR;
 	__cexception_fault_stack[9] = SCB->CFSR;
 	//clear CFSR
@@ -432,6 +1166,7 @@ static  __attribute__( ( naked ) ) void __CException_Fault_Handler( void ) {
 //static void(*__cexception_vector_table[__cexception_vector_table_count])() __attribute__ ((aligned (256)));
 
 extern "C" void __cexception_activate_handlers() {
+	__cexception_backtrace_thread_start();
 	ATOMIC_BLOCK()
 	{
 		void(**currentVectorTable)() = (void(**)())SCB->VTOR;					//get active vector table address
@@ -449,14 +1184,162 @@ extern "C" void __cexception_activate_handlers() {
 	}
 }
 //#endif
+#else
+#include <signal.h>
+#include <ucontext.h>
+
+extern "C" char __executable_start[], etext[];  //provided by the GNU linker
+
+//Host equivalent of the fault handler: synchronous signals are turned into EXCEPTION_HARDWARE on the
+//faulting thread. longjmp out of the handler is safe here because SA_NODEFER leaves the signal unblocked.
+//Data layout differs from the Cortex frame: [6] = pc, [7] = signal, [8] = si_code, [9] = fault address.
+static void __cexception_signal_handler(int sig, siginfo_t* info, void* context) {
+	ucontext_t* uc = (ucontext_t*)context;
+	uintptr_t pc = 0, fp = 0, sp = 0, ret = 0;
+#if defined(__x86_64__)
+	pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+	fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+	sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+	ret = *(const uintptr_t*)sp;
+#elif defined(__aarch64__)
+	pc = (uintptr_t)uc->uc_mcontext.pc;
+	fp = (uintptr_t)uc->uc_mcontext.regs[29];
+	sp = (uintptr_t)uc->uc_mcontext.sp;
+	ret = (uintptr_t)uc->uc_mcontext.regs[30];
+#endif
+	//A call to an invalid address faults before the callee has a frame, so the frame chain would skip the
+	//caller. Its return address is still at sp (lr on AArch64); chain it in front of the caller's frame.
+	uintptr_t callFrame[2] = { fp, ret };
+	if(pc < (uintptr_t)__executable_start || pc >= (uintptr_t)etext)
+		fp = (uintptr_t)callFrame;
+	memset((void*)__cexception_fault_stack, 0, sizeof(__cexception_fault_stack));
+	__cexception_fault_stack[6] = (uint32_t)pc;
+	__cexception_fault_stack[7] = (uint32_t)sig;
+	__cexception_fault_stack[8] = (uint32_t)info->si_code;
+	__cexception_fault_stack[9] = (uint32_t)(uintptr_t)info->si_addr;
+#if CEXCEPTION_FAULT_EXTENDED
+	__cexception_fault_stack[18] = (uint32_t)sp;
+#endif
+
+	volatile uint32_t* exceptionData = __cexception_current_info()->exceptionData;
+	memcpy((void *)exceptionData, (const void*)__cexception_fault_stack, sizeof(__cexception_fault_stack));
+	__cexception_trace(CEXCEPTION_TRACE_FAULT, EXCEPTION_HARDWARE, (const void*)pc, (const uint32_t*)exceptionData, CEXCEPTION_DATA_COUNT);
+	__cexception_post_event(CEXCEPTION_EVENT_FAULT, EXCEPTION_HARDWARE, (const uint32_t*)exceptionData);
+	__cexception_raise(EXCEPTION_HARDWARE, (const void*)pc, nullptr, 0, (const void*)fp);
+}
+
+extern "C" void __cexception_activate_handlers() {
+	__cexception_backtrace_thread_start();
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = __cexception_signal_handler;
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, nullptr);
+	sigaction(SIGBUS, &sa, nullptr);
+	sigaction(SIGILL, &sa, nullptr);
+	sigaction(SIGFPE, &sa, nullptr);
+}
+#endif
+
+static inline volatile CExceptionThreadInfo* __cexception_frame_info(volatile CEXCEPTION_FRAME_T* frame) {
+#if CEXCEPTION_MULTI_TASK
+	//the frame is the first member of its context
+	return &((CExceptionContext*)frame)->info;
+#else
+	(void)frame;
+	return &CExceptionSingleThreadInfo;
+#endif
+}
+
+extern "C" void __cexception_get_last_throw_site(CExceptionThrowSite* site) {
+	volatile CExceptionThreadInfo* info = __cexception_current_info();
+	site->site = info->throwSite;
+	site->file = info->throwFile;
+	site->line = info->throwLine;
+	site->samples = 0;
+}
+
+extern "C" unsigned int __cexception_get_backtrace(const void** frames, unsigned int max) {
+#if CEXCEPTION_BACKTRACE_DEPTH
+	volatile CExceptionThreadInfo* info = __cexception_current_info();
+	unsigned int count = info->backtraceDepth < max ? info->backtraceDepth : max;
+	for(unsigned int i = 0; i < count; i++)
+		frames[i] = info->backtrace[i];
+	return count;
+#else
+	return 0;
+#endif
+}
+
+//Find the Try that handles ExceptionID and return its buffer (null if there is none). On the way, run the
+//cleanup actions pushed inside every block that is left, innermost first: their blocks are about to be jumped
+//over, so their guards will not run. A cleanup entry is popped before its action runs, so an action that
+//throws continues with the remaining ones. A TryFor that does not match is left the way its Catch would
+//leave it, without jumping into it.
+static inline CEXCEPTION_JMP_BUF* __cexception_unwind(volatile CEXCEPTION_FRAME_T* frame, CEXCEPTION_T ExceptionID) {
+	for(;;)
+	{
+		CEXCEPTION_JMP_BUF* target = frame->pFrame;
+		CExceptionCleanup* entry = frame->Cleanups;
+		while(entry && entry->frame == target)
+		{
+			frame->Cleanups = entry->next;
+			entry->action(entry->arg);
+			entry = frame->Cleanups;
+		}
 
-extern "C" void Throw(CEXCEPTION_T ExceptionID)
+		CExceptionFilter* filter = frame->Filters;
+		if(filter == nullptr || filter->frame != target || ExceptionID == CEXCEPTION_NONE ||
+				((uint32_t)ExceptionID & filter->match.mask) == filter->match.value)
+			return target;
+		frame->Filters = filter->next;
+		frame->pFrame = filter->prev;
+	}
+}
+
+static void __cexception_raise(CEXCEPTION_T ExceptionID, const void* site, const char* file, uint32_t line, const void* frame)
 {
-    unsigned int MY_ID = CEXCEPTION_GET_ID;
-    CExceptionFrames[MY_ID].Exception = ExceptionID;
-    if (CExceptionFrames[MY_ID].pFrame)
+    volatile CEXCEPTION_FRAME_T* MY_FRAME = CEXCEPTION_GET_FRAME;
+    if (ExceptionID != CEXCEPTION_NONE)
+    {
+        volatile CExceptionThreadInfo* info = __cexception_frame_info(MY_FRAME);
+        info->throwSite = site;
+        info->throwFile = file;
+        info->throwLine = line;
+#if CEXCEPTION_BACKTRACE_DEPTH
+        info->backtraceDepth = __cexception_capture_backtrace((const void**)info->backtrace, CEXCEPTION_BACKTRACE_DEPTH, site, frame);
+#endif
+#if CEXCEPTION_METRICS
+        __cexception_metrics_throw(MY_FRAME, ExceptionID);
+#endif
+#if CEXCEPTION_PROFILE_SITES
+        __cexception_profile_throw(site, file, line);
+#endif
+    }
+    CEXCEPTION_JMP_BUF* target = __cexception_unwind(MY_FRAME, ExceptionID);
+    MY_FRAME->Exception = ExceptionID;
+    if (target)
     {
-        longjmp(*CExceptionFrames[MY_ID].pFrame, 1);
+        CEXCEPTION_LONGJMP(*target, 1);
     }
+    __cexception_trace(CEXCEPTION_TRACE_UNHANDLED, ExceptionID, nullptr, nullptr, 0);
     CException_Global_Handler(ExceptionID);
 }
+
+//(Throw) keeps the definition intact when CEXCEPTION_THROW_LOCATION turns Throw into a macro
+extern "C" void (Throw)(CEXCEPTION_T ExceptionID)
+{
+    const void* site = __builtin_return_address(0);
+    if (ExceptionID != CEXCEPTION_NONE)
+        __cexception_trace(CEXCEPTION_TRACE_THROW, ExceptionID, site, nullptr, 0);
+    __cexception_raise(ExceptionID, site, nullptr, 0, __builtin_frame_address(0));
+}
+
+extern "C" void __cexception_throw_at(CEXCEPTION_T ExceptionID, const char* file, uint32_t line)
+{
+    const void* site = __builtin_return_address(0);
+    if (ExceptionID != CEXCEPTION_NONE)
+        __cexception_trace(CEXCEPTION_TRACE_THROW, ExceptionID, site, nullptr, 0);
+    __cexception_raise(ExceptionID, site, file, line, __builtin_frame_address(0));
+}
@@ -1,35 +1,151 @@
 #ifndef _CEXCEPTION_H
 #define _CEXCEPTION_H
 
-#include <setjmp.h>
 #include <stdint.h>
+#include "CExceptionJmp.h"
+#ifdef __cplusplus
+#include <type_traits>
+#endif
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-//#ifdef CEXCEPTION_USE_CONFIG_FILE
-//#include "CExceptionConfig.h"
-//#endif
+#ifdef CEXCEPTION_USE_CONFIG_FILE
+#include "CExceptionConfig.h"
+#endif
+
+//Configuration. Every setting can be overridden with a -D flag, by defining it before including this header,
+//or in CExceptionConfig.h (define CEXCEPTION_USE_CONFIG_FILE). All of them are resolved at compile time and
+//must be the same for the library and every translation unit that uses it.
+
+//Exception ids are a 16-bit category and a 16-bit code (CEXCEPTION_ID); the library uses category 0x5A5A.
+//CExceptionIds.h checks id tables for collisions at compile time.
+#define CEXCEPTION_ID(category, code)   ((CEXCEPTION_T)(((uint32_t)(category) << 16) | (uint16_t)(code)))
+#define CEXCEPTION_CATEGORY_OF(id)      ((uint16_t)((uint32_t)(id) >> 16))
+#define CEXCEPTION_CATEGORY_LIBRARY     0x5A5A
 
+#ifndef CEXCEPTION_NONE
 #define CEXCEPTION_NONE      			(0x5A5A5A5A)
+#endif
 #define EXCEPTION_OUT_OF_MEM 			(0x5A5A0000)
 #define EXCEPTION_THREAD_START_FAILED	(0x5A5A0001)
 #define EXCEPTION_TOO_MANY_THREADS      (0x5A5A0002)
+#define EXCEPTION_INVALID_ARGUMENT      (0x5A5A0003)
+#define EXCEPTION_CANCELLED             (0x5A5A0004)
 #define EXCEPTION_HARDWARE				(0x5A5A5AFF)
-#define EXCEPTION_INVALID_ARGUMENT      (0x5A5A0002)
 
+#ifndef CEXCEPTION_T
 #define CEXCEPTION_T        unsigned int
+#endif
+
+//Also record r4-r11, the faulting SP, MMFAR, BFAR and EXC_RETURN on hardware faults (see CExceptionFaultRecord).
+//Costs 12 more words of fault data per thread, so minimal builds leave it off.
+#ifndef CEXCEPTION_FAULT_EXTENDED
+#define CEXCEPTION_FAULT_EXTENDED 0
+#endif
+#if CEXCEPTION_FAULT_EXTENDED
+#define CEXCEPTION_FAULT_WORDS 22
+#else
+#define CEXCEPTION_FAULT_WORDS 10
+#endif
 
-#define CEXCEPTION_DATA_COUNT 10
+//words of fault data kept per thread (the fault handlers fill the first CEXCEPTION_FAULT_WORDS)
+#ifndef CEXCEPTION_DATA_COUNT
+#define CEXCEPTION_DATA_COUNT CEXCEPTION_FAULT_WORDS
+#endif
+#if CEXCEPTION_DATA_COUNT < CEXCEPTION_FAULT_WORDS
+#error "CEXCEPTION_DATA_COUNT must hold the fault record: 10 words, 22 with CEXCEPTION_FAULT_EXTENDED"
+#endif
+
+//Alignment of each thread's exception context (frame + thread info). Must be a power of two; 64 matches the
+//data cache line of common multicore hosts. Parts without a data cache can lower it to save RAM.
+#ifndef CEXCEPTION_CACHE_LINE
+#define CEXCEPTION_CACHE_LINE 64
+#endif
+
+//Per-thread Try/Throw/Catch counters and throw-to-catch latency, see CExceptionMetrics.h
+#ifndef CEXCEPTION_METRICS
+#define CEXCEPTION_METRICS 0
+#endif
+
+//Make Throw(id) record __FILE__ and __LINE__ along with the return address (see CEXCEPTION_THROW_HERE)
+#ifndef CEXCEPTION_THROW_LOCATION
+#define CEXCEPTION_THROW_LOCATION 0
+#endif
+
+//Bytes of per-thread scratch memory released when the Try that allocated it exits (CExceptionArena.h); 0 turns
+//the arena off
+#ifndef CEXCEPTION_ARENA_SIZE
+#define CEXCEPTION_ARENA_SIZE 0
+#endif
+
+//Give NEW_THREAD stacks from a static arena of fixed stack classes instead of the heap (CExceptionStacks.h)
+#ifndef CEXCEPTION_STACK_ARENA
+#define CEXCEPTION_STACK_ARENA 0
+#endif
+
+//Paint each NEW_THREAD stack when the thread starts and track stack high-water marks and Try nesting per
+//thread (__cexception_stack_usage); costs a store in every Try and a fill of the stack at thread start
+#ifndef CEXCEPTION_STACK_USAGE
+#define CEXCEPTION_STACK_USAGE 0
+#endif
+
+//Bytes NEW_THREAD adds to every requested stack size for the thread wrapper
+#ifndef CEXCEPTION_THREAD_STACK_EXTRA
+#define CEXCEPTION_THREAD_STACK_EXTRA 256
+#endif
+
+//Return addresses kept per thread for the backtrace of its last exception (CExceptionBacktrace.h); 0 turns capture off
+#ifndef CEXCEPTION_BACKTRACE_DEPTH
+#define CEXCEPTION_BACKTRACE_DEPTH 16
+#endif
+
+//Thread model. With CEXCEPTION_MULTI_TASK set to 0 there is a single exception frame: CEXCEPTION_GET_ID is the
+//constant 0, Try/Throw use the frame's address directly and the thread registry (NEW_THREAD, registration,
+//thread lists) is not compiled at all.
+#ifndef CEXCEPTION_MULTI_TASK
+#define CEXCEPTION_MULTI_TASK 1
+#endif
+
+//How a multi-task build finds the calling thread's slot (CEXCEPTION_GET_ID, run by every Try and Throw):
+//  CEXCEPTION_ID_SCAN  compare the current thread against every registered slot, O(n), no extra memory
+//  CEXCEPTION_ID_TLS   cache the slot in thread-local storage, O(1), needs __thread support (default)
+//  CEXCEPTION_ID_HASH  look the current thread handle up in the registry's hash index, O(1), no TLS; like SCAN
+//                      it enters the registry's read side on every call, an atomic increment and decrement of a
+//                      counter shared by all threads, which contends once many cores Try and Throw at once
+#define CEXCEPTION_ID_SCAN 1
+#define CEXCEPTION_ID_TLS  2
+#define CEXCEPTION_ID_HASH 3
+#ifndef CEXCEPTION_ID_PROVIDER
+#if defined(CEXCEPTION_USE_TLS) && !CEXCEPTION_USE_TLS
+#define CEXCEPTION_ID_PROVIDER CEXCEPTION_ID_SCAN
+#else
+#define CEXCEPTION_ID_PROVIDER CEXCEPTION_ID_TLS
+#endif
+#endif
+#if CEXCEPTION_ID_PROVIDER != CEXCEPTION_ID_SCAN && CEXCEPTION_ID_PROVIDER != CEXCEPTION_ID_TLS && CEXCEPTION_ID_PROVIDER != CEXCEPTION_ID_HASH
+#error "CEXCEPTION_ID_PROVIDER must be CEXCEPTION_ID_SCAN, CEXCEPTION_ID_TLS or CEXCEPTION_ID_HASH"
+#endif
 
 struct CExceptionThreadInfo {
 	void* handle;
 	void(*exceptionCallback)(CEXCEPTION_T, CExceptionThreadInfo*);
 	uint32_t exceptionData[CEXCEPTION_DATA_COUNT];
+	//where the last exception of this thread was raised: return address of the Throw call (or faulting pc),
+	//and file/line when it was thrown with CEXCEPTION_THROW_HERE
+	const void* throwSite;
+	const char* throwFile;
+	uint32_t throwLine;
+#if CEXCEPTION_BACKTRACE_DEPTH
+	//return addresses leading to it, innermost (the throw site or faulting pc) first
+	const void* backtrace[CEXCEPTION_BACKTRACE_DEPTH];
+	uint32_t backtraceDepth;
+#endif
 };
 
+#if CEXCEPTION_MULTI_TASK
 unsigned int __cexception_get_task_number(void* threadHandle);
 unsigned int __cexception_get_current_task_number();
 unsigned int __cexception_register_thread(void* threadHandle, const char* name, void(*exceptionCallback)(CEXCEPTION_T, CExceptionThreadInfo*));
@@ -38,22 +154,71 @@ void __cexception_unregister_current_thread();
 void __cexception_set_number_of_threads(unsigned int num);
 unsigned int __cexception_get_number_of_threads();
 void __cexception_thread_create(void** thread, const char* name, unsigned int priority, void(*fun)(void*), void* thread_param, unsigned int stack_size, void(*cb)(CEXCEPTION_T, CExceptionThreadInfo*));
-void __cexception_activate_handlers();
+//called by NEW_THREAD once the thread has started, just before it is registered; weak and empty. A Throw from
+//it fails the registration, e.g. to test that path.
+void __cexception_registration_hook();
 unsigned int __cexception_get_active_thread_count();
+void __cexception_dump_thread_list(unsigned int idToHighlight);
+//the same without threadHandle's line, for reports made after that thread's slot may have been released
+void __cexception_dump_other_threads(const void* threadHandle);
+
+#if CEXCEPTION_STACK_USAGE
+typedef struct {
+	unsigned int id;
+	void* handle;           //null once the thread has been unregistered (the slot keeps its figures until reused)
+	uint32_t stackSize;     //0 if the thread was not started by NEW_THREAD
+	uint32_t stackPeak;     //most bytes of it ever used
+	uint16_t tryDepthMax;   //deepest Try nesting
+	uint32_t jmpBufBytes;   //stack taken by the jump buffers at that depth
+} CExceptionStackUsage;
+
+//fill up to max entries, one for each thread slot in use or holding figures of an ended thread; returns the
+//number of such slots
+unsigned int __cexception_stack_usage(CExceptionStackUsage* usage, unsigned int max);
+//log them, like __cexception_dump_thread_list
+void __cexception_dump_stack_usage();
+#endif
+#endif
+void __cexception_activate_handlers();
 uint32_t* __cexception_get_current_thread_exception_data();
+CExceptionThreadInfo* __cexception_get_current_thread_info();
 void* __cexception_get_current_thread_handle();
 const char* __cexception_get_thread_name(const void* threadHandle);
 const char* __cexception_get_current_thread_name();
 
 #define CEXCEPTION_CURRENT_DATA __cexception_get_current_thread_exception_data()
 
+//CEXCEPTION_CURRENT_DATA after a hardware fault on Cortex-M. The first eight words are the frame the core stacked
+//on exception entry; mmfar and bfar only hold an address when CFSR.MMARVALID or CFSR.BFARVALID is set.
+//The host build uses its own layout: pc, signal, si_code and fault address in place of pc, psr, hfsr and cfsr,
+//and only sp of the extended part.
+typedef struct {
+	uint32_t r0, r1, r2, r3, r12, lr, pc, psr;
+	uint32_t hfsr, cfsr;
+#if CEXCEPTION_FAULT_EXTENDED
+	uint32_t r4, r5, r6, r7, r8, r9, r10, r11;
+	uint32_t sp;            //of the faulting code, before the core stacked its frame
+	uint32_t mmfar, bfar;
+	uint32_t excReturn;     //lr on exception entry: mode and stack the fault came from
+#endif
+} CExceptionFaultRecord;
+
+#ifdef __cplusplus
+static_assert(sizeof(CExceptionFaultRecord) == CEXCEPTION_FAULT_WORDS * sizeof(uint32_t), "CExceptionFaultRecord layout");
+#endif
+
+#define CEXCEPTION_CURRENT_FAULT ((const CExceptionFaultRecord*)CEXCEPTION_CURRENT_DATA)
+
 #define CEXCEPTION_ACTIVATE_HW_HANDLERS() __cexception_activate_handlers()
+
+#if CEXCEPTION_MULTI_TASK
 #define CEXCEPTION_SET_NUM_THREADS(number) __cexception_set_number_of_threads(number)
 
 #define CEXCEPTION_REGISTER_THREAD(threadHandle) __cexception_register_new_thread(threadHandle)
 #define CEXCEPTION_UNREGISTER_THREAD(threadHandle) __cexceptionregister_end_thread(threadHandle)
 
 #define CEXCEPTION_GET_ID __cexception_get_current_task_number()
+#define CEXCEPTION_GET_FRAME __cexception_get_current_frame()
 
 #define NEW_THREAD(threadHandle_p, taskName, priority, taskFunction, taskArg, stackSize, exceptionCallback)   __cexception_thread_create(threadHandle_p, taskName, priority, taskFunction, taskArg, stackSize, exceptionCallback)
 
@@ -62,11 +227,26 @@ const char* __cexception_get_current_thread_name();
 	    os_thread_cleanup(threadHandle); } while(0)
 
 #define END_THREAD()	KILL_THREAD(nullptr)
+#else
+#define CEXCEPTION_GET_ID 0u
+#define CEXCEPTION_GET_FRAME (&__cexception_frame)
+#endif
 
-#define BEGIN_LOCK_SAFE(lock) { std::lock_guard<decltype(lock)> __lock##lock((lock)); CEXCEPTION_T __lock_safe_e = CEXCEPTION_NONE; decltype(lock)* __lock_safe_lock = &(lock); Try
-//when BEGIN_LOCK_SAFE is used in unregistering the current thread, the Catch will have an invalid id and might throw inadvertently
-//as a result, we should re-check in the catch block.
-#define END_LOCK_SAFE() Catch(__lock_safe_e) { } if(__lock_safe_e != CEXCEPTION_NONE) { __lock_safe_lock->unlock(); Throw(__lock_safe_e); } }
+//Pass-through frames. Instead of a Try that catches, cleans up and rethrows (one setjmp on entry and one more
+//longjmp per level on the way out), a block can push a cleanup action on the thread's cleanup stack
+//(CEXCEPTION_FRAME_T::Cleanups). Throw runs every action pushed since the target Try started, innermost first,
+//then jumps once, straight to that Try. Neither kind of block costs a setjmp, and leaving one normally (also
+//with break or return) just pops it.
+//A block must not change the calling thread's registration and then throw: its entry would be on the stack
+//of the old slot.
+
+//Hold lock for the enclosed block; it is unlocked when the block is left either way.
+#define BEGIN_LOCK_SAFE(lock) { CExceptionLockGuard<std::remove_reference<decltype(lock)>::type> __lock_safe_guard((lock));
+#define END_LOCK_SAFE() }
+
+//Run action (anything callable with no arguments, e.g. a lambda) if an exception leaves the enclosed block.
+#define BEGIN_CLEANUP(action) { auto __cleanup_action = (action); CExceptionCleanupGuard<decltype(__cleanup_action)> __cleanup_guard(__cleanup_action);
+#define END_CLEANUP() }
 
 //These hooks allow you to inject custom code into places, particularly useful for saving and restoring additional state
 #ifndef CEXCEPTION_HOOK_START_TRY
@@ -82,52 +262,214 @@ const char* __cexception_get_current_thread_name();
 #define CEXCEPTION_HOOK_START_CATCH
 #endif
 
+//entry of a thread's cleanup stack, lives in the block that pushed it
+typedef struct CExceptionCleanup {
+  struct CExceptionCleanup* next;
+  CEXCEPTION_JMP_BUF* frame;        //innermost Try when it was pushed
+  void (*action)(void* arg);
+  void* arg;
+} CExceptionCleanup;
+
+//set of exception ids: those with (id & mask) == value
+typedef struct {
+  uint32_t mask;
+  uint32_t value;
+} CExceptionMatch;
+
+static inline CExceptionMatch __cexception_match(uint32_t mask, uint32_t value) {
+  CExceptionMatch match;
+  match.mask = mask;
+  match.value = value & mask;
+  return match;
+}
+
+#define CEXCEPTION_MATCH_ID(id)               __cexception_match(0xFFFFFFFFu, (uint32_t)(id))
+#define CEXCEPTION_MATCH_CATEGORY(category)   __cexception_match(0xFFFF0000u, (uint32_t)(category) << 16)
+
+//entry of a thread's filter stack, lives in the TryFor block it describes
+typedef struct CExceptionFilter {
+  struct CExceptionFilter* next;
+  CEXCEPTION_JMP_BUF* frame;        //the TryFor
+  CEXCEPTION_JMP_BUF* prev;         //the Try around it
+  CExceptionMatch match;
+} CExceptionFilter;
+
 //exception frame structures
 typedef struct {
-  jmp_buf* pFrame;
+  CEXCEPTION_JMP_BUF* pFrame;
   CEXCEPTION_T volatile Exception;
+  CExceptionCleanup* Cleanups;      //innermost first
+  CExceptionFilter* Filters;        //innermost first
+#if CEXCEPTION_METRICS
+  uint32_t Tries;       //written only by the owning thread
+#endif
+#if CEXCEPTION_ARENA_SIZE
+  uint8_t* ArenaBase;   //allocated on first use, kept for the slot's lifetime
+  uint32_t ArenaTop;    //bytes in use; each Try restores it on exit
+#endif
+#if CEXCEPTION_STACK_USAGE
+  uint16_t TryDepth;    //Try levels the thread is in; each Try restores it on exit. Not kept in the frame
+  uint16_t TryDepthMax; //shared by unregistered threads (see CEXCEPTION_TRACKS_DEPTH)
+#endif
 } CEXCEPTION_FRAME_T;
 
-//actual root frame storage (only one if single-tasking)
-extern volatile CEXCEPTION_FRAME_T * volatile CExceptionFrames;
+#if CEXCEPTION_METRICS
+void __cexception_metrics_catch(volatile CEXCEPTION_FRAME_T* frame, CEXCEPTION_T e);
+#define CEXCEPTION_METRICS_START_TRY(frame) ((frame)->Tries = (frame)->Tries + 1)
+#define CEXCEPTION_METRICS_START_CATCH(frame, e) __cexception_metrics_catch(frame, e)
+#else
+#define CEXCEPTION_METRICS_START_TRY(frame)
+#define CEXCEPTION_METRICS_START_CATCH(frame, e)
+#endif
+
+//frame of the calling thread (the shared frame 0 if it is not registered), or of a given slot.
+//Frames never move once allocated, so a Try keeps the pointer for its whole lifetime.
+volatile CEXCEPTION_FRAME_T* __cexception_get_current_frame();
+volatile CEXCEPTION_FRAME_T* __cexception_get_frame(unsigned int id);
+
+#if CEXCEPTION_STACK_USAGE
+#if CEXCEPTION_MULTI_TASK
+//slot 0's frame, used by every unregistered thread at once: counting Try depth there would race
+extern volatile CEXCEPTION_FRAME_T* const __cexception_shared_frame;
+#define CEXCEPTION_TRACKS_DEPTH(frame) ((frame) != __cexception_shared_frame)
+#else
+#define CEXCEPTION_TRACKS_DEPTH(frame) true
+#endif
+#endif
+#if !CEXCEPTION_MULTI_TASK
+extern volatile CEXCEPTION_FRAME_T __cexception_frame;
+#endif
 
-//Try (see C file for explanation)
+//Try (see C file for explanation). The block is a cexception::Scope, see CExceptionScope.h.
+//The frame is looked up once: MY_FRAME is declared in an if that spans both the block and the Catch handler,
+//and the end of the block jumps to the handler's test in that if's else branch. Only if and goto are added
+//around the user's code, so break and continue still reach the enclosing loop.
 #define Try                                                         \
-    {                                                               \
-        jmp_buf *PrevFrame, NewFrame;                               \
-        unsigned int MY_ID = CEXCEPTION_GET_ID;                     \
-        PrevFrame = CExceptionFrames[MY_ID].pFrame;                 \
-        CExceptionFrames[MY_ID].pFrame = (jmp_buf*)(&NewFrame);     \
-        CExceptionFrames[MY_ID].Exception = CEXCEPTION_NONE;        \
+    if (volatile CEXCEPTION_FRAME_T* const MY_FRAME = CEXCEPTION_GET_FRAME) { \
+        cexception::Scope MY_SCOPE(MY_FRAME);                       \
+        MY_SCOPE.enter();                                           \
+        CEXCEPTION_HOOK_START_TRY;                                  \
+        if (CEXCEPTION_SETJMP(MY_SCOPE.jmp) == 0) {                 \
+            if (1)
+
+//Try that only handles the ids in filter (a CExceptionMatch, e.g. CEXCEPTION_MATCH_CATEGORY(c)). Throw checks
+//the filter before jumping: any other id skips this block and goes straight to the next Try out, without
+//entering its Catch. ExitTry() always leaves the innermost block. Ends with Catch(e) like Try.
+#define TryFor(filter)                                              \
+    if (volatile CEXCEPTION_FRAME_T* const MY_FRAME = CEXCEPTION_GET_FRAME) { \
+        cexception::FilteredScope MY_SCOPE(MY_FRAME, (filter));     \
+        MY_SCOPE.enter();                                           \
         CEXCEPTION_HOOK_START_TRY;                                  \
-        if (setjmp(NewFrame) == 0) {                                \
+        if (CEXCEPTION_SETJMP(MY_SCOPE.jmp) == 0) {                 \
             if (1)
 
-//Catch (see C file for explanation)
-#define Catch(e)                                                    \
+//Catch (see C file for explanation). The label is numbered so that a function can hold any number of them.
+#define Catch(e) CEXCEPTION_CATCH_AT(e, __COUNTER__)
+#define CEXCEPTION_CATCH_AT(e, n) CEXCEPTION_CATCH_LABELLED(e, CEXCEPTION_CATCH_LABEL(n))
+#define CEXCEPTION_CATCH_LABEL(n) __cexception_catch_ ## n
+#define CEXCEPTION_CATCH_LABELLED(e, label)                         \
             else { }                                                \
-            CExceptionFrames[MY_ID].Exception = CEXCEPTION_NONE;    \
+            MY_SCOPE.passed();                                      \
             CEXCEPTION_HOOK_HAPPY_TRY;                              \
         }                                                           \
         else                                                        \
         {                                                           \
-        	e = CExceptionFrames[MY_ID].Exception;                  \
+            e = MY_SCOPE.caught();                                  \
             (void)e;                                                \
             CEXCEPTION_HOOK_START_CATCH;                            \
         }                                                           \
-        CExceptionFrames[MY_ID].pFrame = PrevFrame;                 \
+        MY_SCOPE.leave();                                           \
         CEXCEPTION_HOOK_AFTER_TRY;                                  \
-    }                                                               \
-	if(CExceptionFrames[CEXCEPTION_GET_ID].Exception != CEXCEPTION_NONE)
+        goto label;                                                 \
+    } else label:                                                   \
+        if (MY_FRAME->Exception != CEXCEPTION_NONE)
 
 //Throw an Error
 void Throw(CEXCEPTION_T ExceptionID);
 
+//Throw and record the source location as well; the location strings must be static
+void __cexception_throw_at(CEXCEPTION_T ExceptionID, const char* file, uint32_t line);
+#define CEXCEPTION_THROW_HERE(id) __cexception_throw_at((id), __FILE__, __LINE__)
+#if CEXCEPTION_THROW_LOCATION
+#define Throw(id) CEXCEPTION_THROW_HERE(id)
+#endif
+
 //Just exit the Try block and skip the Catch.
 #define ExitTry() Throw(CEXCEPTION_NONE)
 
 #ifdef __cplusplus
 }   // extern "C"
+
+//An entry of the cleanup stack for the lifetime of the object; see BEGIN_CLEANUP
+class CExceptionCleanupScope {
+public:
+	CExceptionCleanupScope(void (*action)(void*), void* arg) {
+		frame = CEXCEPTION_GET_FRAME;
+		entry.next = frame->Cleanups;
+		entry.frame = frame->pFrame;
+		entry.action = action;
+		entry.arg = arg;
+		frame->Cleanups = &entry;
+	}
+
+	~CExceptionCleanupScope() {
+		if(frame)
+			pop();
+	}
+
+	CExceptionCleanupScope(const CExceptionCleanupScope&) = delete;
+	CExceptionCleanupScope& operator=(const CExceptionCleanupScope&) = delete;
+
+protected:
+	//take the entry off the stack ahead of the destructor, for a derived destructor that undoes the action
+	//itself: once that has started, a Throw must not run the action as well
+	void pop() {
+		frame->Cleanups = entry.next;
+		frame = nullptr;
+	}
+
+private:
+	volatile CEXCEPTION_FRAME_T* frame;
+	CExceptionCleanup entry;
+};
+
+template<typename Action>
+class CExceptionCleanupGuard : CExceptionCleanupScope {
+public:
+	explicit CExceptionCleanupGuard(Action& action) : CExceptionCleanupScope(&run, &action) { }
+
+private:
+	static void run(void* action) {
+		(*static_cast<Action*>(action))();
+	}
+};
+
+//see BEGIN_LOCK_SAFE
+template<typename Lock>
+class CExceptionLockGuard : CExceptionCleanupScope {
+public:
+	explicit CExceptionLockGuard(Lock& lock) : CExceptionCleanupScope(acquire(lock), &lock), lock(lock) { }
+
+	~CExceptionLockGuard() {
+		pop();
+		lock.unlock();
+	}
+
+private:
+	//locks before the entry is pushed
+	static void (*acquire(Lock& lock))(void*) {
+		lock.lock();
+		return &release;
+	}
+
+	static void release(void* lock) {
+		static_cast<Lock*>(lock)->unlock();
+	}
+
+	Lock& lock;
+};
+
+#include "CExceptionScope.h"
 #endif
 
 
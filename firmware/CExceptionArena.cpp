@@ -0,0 +1,41 @@
+#include "CExceptionArena.h"
+#include <stdlib.h>
+
+#if CEXCEPTION_ARENA_SIZE
+
+static_assert((CEXCEPTION_ARENA_ALIGN & (CEXCEPTION_ARENA_ALIGN - 1)) == 0, "CEXCEPTION_ARENA_ALIGN must be a power of two");
+static_assert(CEXCEPTION_ARENA_SIZE % CEXCEPTION_ARENA_ALIGN == 0, "CEXCEPTION_ARENA_SIZE must be a multiple of CEXCEPTION_ARENA_ALIGN");
+
+extern "C" void* __cexception_arena_alloc(size_t size) {
+	volatile CEXCEPTION_FRAME_T* frame = CEXCEPTION_GET_FRAME;
+	if(frame->ArenaBase == nullptr)
+	{
+		//malloc alignment is enough for CEXCEPTION_ARENA_ALIGN on every supported target
+		frame->ArenaBase = (uint8_t*)malloc(CEXCEPTION_ARENA_SIZE);
+		if(frame->ArenaBase == nullptr)
+			Throw(EXCEPTION_OUT_OF_MEM);
+	}
+	uint32_t top = (frame->ArenaTop + (CEXCEPTION_ARENA_ALIGN - 1)) & ~(uint32_t)(CEXCEPTION_ARENA_ALIGN - 1);
+	if(size > CEXCEPTION_ARENA_SIZE - top)
+		Throw(EXCEPTION_OUT_OF_MEM);
+	frame->ArenaTop = top + (uint32_t)size;
+	return frame->ArenaBase + top;
+}
+
+extern "C" size_t __cexception_arena_available() {
+	return CEXCEPTION_ARENA_SIZE - CEXCEPTION_GET_FRAME->ArenaTop;
+}
+
+#else
+
+extern "C" void* __cexception_arena_alloc(size_t size) {
+	(void)size;
+	Throw(EXCEPTION_OUT_OF_MEM);
+	return nullptr;
+}
+
+extern "C" size_t __cexception_arena_available() {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _CEXCEPTION_ARENA_H
+#define _CEXCEPTION_ARENA_H
+
+#include <stddef.h>
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Exception-scoped scratch memory (CEXCEPTION_ARENA_SIZE > 0).
+//
+//Every thread slot has a bump arena of CEXCEPTION_ARENA_SIZE bytes. Each Try remembers how much of it is in
+//use when it starts and gives back everything allocated since when it exits: at the end of the body, through
+//ExitTry() or because of a Throw, including one from a nested function. Memory from __cexception_arena_alloc()
+//is therefore valid until the innermost enclosing Try exits and never has to be freed. Allocation is a bounds
+//check and an add; the arena itself is allocated on the thread's first request and reused by later threads of
+//the same slot.
+//
+//Allocations made outside any Try stay until the thread is unregistered. Unregistered threads share slot 0, so
+//like Try they must not use it concurrently.
+
+//alignment of every allocation, a power of two
+#ifndef CEXCEPTION_ARENA_ALIGN
+#define CEXCEPTION_ARENA_ALIGN (2 * sizeof(void*))
+#endif
+
+//size bytes from the calling thread's arena; throws EXCEPTION_OUT_OF_MEM if they do not fit
+void* __cexception_arena_alloc(size_t size);
+
+//bytes still free in the calling thread's arena
+size_t __cexception_arena_available();
+
+#define CEXCEPTION_ARENA_ALLOC(size) __cexception_arena_alloc(size)
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_ARENA_H
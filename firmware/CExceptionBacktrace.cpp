@@ -0,0 +1,107 @@
+#include "CExceptionBacktrace.h"
+#include "application.h"
+
+//Stores a return address unless it repeats the previous one (the throw site is both pc and the first return
+//address found on the stack); returns false once frames is full.
+static inline bool __cexception_backtrace_add(const void** frames, unsigned int max, unsigned int& count, uintptr_t address) {
+	if(count && frames[count - 1] == (const void*)address)
+		return true;
+	frames[count++] = (const void*)address;
+	return count < max;
+}
+
+#ifdef CEXCEPTION_PLATFORM_HOST
+#if defined(__x86_64__) || defined(__aarch64__)
+//Both ABIs keep {previous frame pointer, return address} at the frame pointer.
+
+//bounds of the calling thread's stack, cached by __cexception_backtrace_thread_start; both 0 until then
+static __thread uintptr_t __cexception_stack_low;
+static __thread uintptr_t __cexception_stack_high;
+
+extern "C" void __cexception_backtrace_thread_start() {
+	void* base;
+	size_t size;
+	if(os_thread_current_stack(&base, &size))
+	{
+		__cexception_stack_low = (uintptr_t)base;
+		__cexception_stack_high = (uintptr_t)base + size;
+	}
+}
+
+extern "C" unsigned int __cexception_capture_backtrace(const void** frames, unsigned int max, const void* pc, const void* frame) {
+	unsigned int count = 0;
+	if(max == 0)
+		return 0;
+	if(pc && !__cexception_backtrace_add(frames, max, count, (uintptr_t)pc))
+		return count;
+
+	//without cached bounds (e.g. a thread that was never registered) nothing beyond pc is safe to read
+	uintptr_t low = __cexception_stack_low;
+	uintptr_t high = __cexception_stack_high;
+	if(high == 0)
+		return count;
+	const uintptr_t* fp = (const uintptr_t*)frame;
+	for(unsigned int steps = 0; steps < max; steps++)
+	{
+		if((uintptr_t)fp < low || (uintptr_t)fp > high - 2 * sizeof(uintptr_t) || ((uintptr_t)fp & (sizeof(uintptr_t) - 1)))
+			break;
+		uintptr_t ret = fp[1];
+		if(ret == 0 || !__cexception_backtrace_add(frames, max, count, ret))
+			break;
+		//frames grow down, so the caller's frame is always higher
+		const uintptr_t* next = (const uintptr_t*)fp[0];
+		if(next <= fp)
+			break;
+		fp = next;
+	}
+	return count;
+}
+#else
+extern "C" void __cexception_backtrace_thread_start() {
+}
+
+extern "C" unsigned int __cexception_capture_backtrace(const void** frames, unsigned int max, const void* pc, const void* frame) {
+	unsigned int count = 0;
+	if(max && pc)
+		__cexception_backtrace_add(frames, max, count, (uintptr_t)pc);
+	return count;
+}
+#endif
+
+#else
+
+//true if address (with the Thumb bit set) is just after a BL or BLX Rm
+static inline bool __cexception_is_return_address(uintptr_t address) {
+	if(!(address & 1))
+		return false;
+	address &= ~(uintptr_t)1;
+	if(address < CEXCEPTION_CODE_START + 4 || address >= CEXCEPTION_CODE_END)
+		return false;
+	uint16_t hw1 = *(const uint16_t*)(address - 4);
+	uint16_t hw2 = *(const uint16_t*)(address - 2);
+	if((hw1 & 0xF800) == 0xF000 && (hw2 & 0xD000) == 0xD000)       //BL <label>
+		return true;
+	return (hw2 & 0xFF87) == 0x4780;                                //BLX Rm
+}
+
+//the scan is bounded by CEXCEPTION_RAM_END, there is nothing to cache
+extern "C" void __cexception_backtrace_thread_start() {
+}
+
+extern "C" unsigned int __cexception_capture_backtrace(const void** frames, unsigned int max, const void* pc, const void* frame) {
+	unsigned int count = 0;
+	if(max == 0)
+		return 0;
+	if(pc && !__cexception_backtrace_add(frames, max, count, (uintptr_t)pc))
+		return count;
+
+	const uint32_t* sp = (const uint32_t*)((uintptr_t)frame & ~(uintptr_t)3);
+	for(unsigned int words = 0; words < CEXCEPTION_BACKTRACE_SCAN_WORDS && (uintptr_t)(sp + 1) <= CEXCEPTION_RAM_END; words++, sp++)
+	{
+		if(__cexception_is_return_address(*sp) && !__cexception_backtrace_add(frames, max, count, *sp))
+			break;
+	}
+	return count;
+}
+
+#endif
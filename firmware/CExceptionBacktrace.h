@@ -0,0 +1,58 @@
+#ifndef _CEXCEPTION_BACKTRACE_H
+#define _CEXCEPTION_BACKTRACE_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Bounded backtrace capture.
+//
+//Throw and the fault handlers store up to CEXCEPTION_BACKTRACE_DEPTH return addresses in the context of the
+//thread that raised the exception, innermost first. Capture never allocates, locks or calls into the OS, and
+//its worst case is fixed at compile time, so it can stay on in the recovery path:
+// - host (x86-64, AArch64): follows the frame-pointer chain, at most CEXCEPTION_BACKTRACE_DEPTH steps. The host
+//   build compiles with -fno-omit-frame-pointer. Every frame is checked against the thread's stack bounds, so
+//   code without frame pointers ends the walk early instead of faulting. The bounds are cached per thread by
+//   __cexception_backtrace_thread_start (os_thread_current_stack), which NEW_THREAD threads, threads that
+//   register themselves and the thread calling CEXCEPTION_ACTIVATE_HW_HANDLERS run; other threads get only
+//   the throw site or faulting pc.
+// - Cortex-M: GCC's Thumb frames cannot be walked without unwind tables, so the stack is scanned upwards from
+//   the throw point for at most CEXCEPTION_BACKTRACE_SCAN_WORDS words. A word is kept if it is an odd address
+//   inside [CEXCEPTION_CODE_START, CEXCEPTION_CODE_END) that follows a BL or BLX instruction. Stale return
+//   addresses left in unused stack slots can show up as extra frames.
+
+//stack words examined on Cortex-M
+#ifndef CEXCEPTION_BACKTRACE_SCAN_WORDS
+#define CEXCEPTION_BACKTRACE_SCAN_WORDS 256
+#endif
+
+//executable flash and the end of RAM (the scan never reads past it); defaults fit the STM32F2
+#ifndef CEXCEPTION_CODE_START
+#define CEXCEPTION_CODE_START 0x08000000u
+#endif
+#ifndef CEXCEPTION_CODE_END
+#define CEXCEPTION_CODE_END 0x08100000u
+#endif
+#ifndef CEXCEPTION_RAM_END
+#define CEXCEPTION_RAM_END 0x20020000u
+#endif
+
+//Store up to max return addresses in frames and return how many were stored. pc, if not null, is stored first;
+//the walk starts at frame, a frame address of the calling thread (__builtin_frame_address(0), or the frame
+//pointer of a faulting context).
+unsigned int __cexception_capture_backtrace(const void** frames, unsigned int max, const void* pc, const void* frame);
+
+//cache the calling thread's stack bounds for capture; not from a signal handler
+void __cexception_backtrace_thread_start();
+
+//copy the backtrace of the calling thread's last exception; returns the number of frames copied
+unsigned int __cexception_get_backtrace(const void** frames, unsigned int max);
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_BACKTRACE_H
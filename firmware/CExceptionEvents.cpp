@@ -0,0 +1,202 @@
+#include "CExceptionEvents.h"
+#include "application.h"
+#include <string.h>
+#include <atomic>
+#include "logging.h"
+
+LOG_SOURCE_CATEGORY("cexception");
+
+//Bounded MPMC ring after Vyukov: each cell carries a sequence number that says whose turn it is. A producer
+//may fill cell pos & mask when its sequence equals pos, and publishes it by setting it to pos + 1; the
+//consumer takes it when the sequence is pos + 1 and hands it back for the next lap with pos + size.
+//Sequences are stored relative to the cell index so that the zero-initialised ring is already valid.
+//Producers never wait on each other or on the consumer, so posting is safe from the fault handler and from
+//signal handlers.
+
+struct CExceptionEventCell {
+	std::atomic<uint32_t> sequence;
+	CExceptionEvent event;
+};
+
+static CExceptionEventCell CExceptionEventRing[CEXCEPTION_EVENT_QUEUE_SIZE];
+static std::atomic<uint32_t> CExceptionEventHead(0);    //next position to post
+static std::atomic<uint32_t> CExceptionEventTail(0);    //next position to poll
+static std::atomic<uint32_t> CExceptionEventsPosted(0);
+static std::atomic<uint32_t> CExceptionEventsDropped(0);
+static std::atomic<uint32_t> CExceptionEventsReported(0);
+static std::atomic<uint32_t> CExceptionEventsHighWater(0);
+static std::atomic<bool> CExceptionReporterRunning(false);
+
+static inline uint32_t __cexception_event_sequence(uint32_t index) {
+	return CExceptionEventRing[index].sequence.load(std::memory_order_acquire) + index;
+}
+
+static inline void __cexception_set_event_sequence(uint32_t index, uint32_t sequence) {
+	CExceptionEventRing[index].sequence.store(sequence - index, std::memory_order_release);
+}
+
+static bool __cexception_push_event(const CExceptionEvent* event) {
+	uint32_t pos = CExceptionEventHead.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		uint32_t index = pos & (CEXCEPTION_EVENT_QUEUE_SIZE - 1);
+		int32_t diff = (int32_t)(__cexception_event_sequence(index) - pos);
+		if(diff == 0)
+		{
+			if(CExceptionEventHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				CExceptionEventRing[index].event = *event;
+				__cexception_set_event_sequence(index, pos + 1);
+				break;
+			}
+		}
+		else if(diff < 0)
+		{
+			CExceptionEventsDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+			pos = CExceptionEventHead.load(std::memory_order_relaxed);
+	}
+
+	CExceptionEventsPosted.fetch_add(1, std::memory_order_relaxed);
+	uint32_t waiting = pos + 1 - CExceptionEventTail.load(std::memory_order_relaxed);
+	uint32_t highWater = CExceptionEventsHighWater.load(std::memory_order_relaxed);
+	while(waiting > highWater && waiting <= CEXCEPTION_EVENT_QUEUE_SIZE &&
+			!CExceptionEventsHighWater.compare_exchange_weak(highWater, waiting, std::memory_order_relaxed))
+		;
+	return true;
+}
+
+extern "C" bool __cexception_poll_event(CExceptionEvent* event) {
+	uint32_t pos = CExceptionEventTail.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		uint32_t index = pos & (CEXCEPTION_EVENT_QUEUE_SIZE - 1);
+		int32_t diff = (int32_t)(__cexception_event_sequence(index) - (pos + 1));
+		if(diff == 0)
+		{
+			if(CExceptionEventTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				*event = CExceptionEventRing[index].event;
+				__cexception_set_event_sequence(index, pos + CEXCEPTION_EVENT_QUEUE_SIZE);
+				return true;
+			}
+		}
+		else if(diff < 0)
+			return false;
+		else
+			pos = CExceptionEventTail.load(std::memory_order_relaxed);
+	}
+}
+
+extern "C" bool __cexception_post_event(CExceptionEventType type, CEXCEPTION_T exception, const uint32_t* data) {
+	CExceptionEvent event;
+	memset(&event, 0, sizeof(event));
+	event.type = (uint8_t)type;
+	event.threadId = (uint16_t)CEXCEPTION_GET_ID;
+	event.exception = exception;
+	event.timestamp = millis();
+	event.handle = __cexception_get_current_thread_handle();
+	strncpy(event.name, __cexception_get_thread_name(event.handle), sizeof(event.name) - 1);
+	if(data)
+		memcpy(event.data, data, sizeof(event.data));
+
+	bool posted = __cexception_push_event(&event);
+	if(!CExceptionReporterRunning.load())
+		__cexception_report_events();
+	return posted;
+}
+
+extern "C" void __cexception_report_events() {
+	CExceptionEvent event;
+	while(__cexception_poll_event(&event))
+	{
+		__cexception_report_event(&event);
+		CExceptionEventsReported.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+extern "C" __attribute__((weak)) void __cexception_report_event(const CExceptionEvent* event) {
+	switch(event->type)
+	{
+	case CEXCEPTION_EVENT_THREAD_STARTED:
+		LOG(INFO, "Thread %u (%s @ 0x%08lx) started", event->threadId, event->name, (unsigned long)(uintptr_t)event->handle);
+		break;
+	case CEXCEPTION_EVENT_THREAD_DIED:
+		LOG(ERROR, "Exception 0x%08x not handled in thread %u (%s @ 0x%08lx).", event->exception, event->threadId, event->name, (unsigned long)(uintptr_t)event->handle);
+		LOG(ERROR, "Thread %u terminated. **WARNING: dynamic or external resources are not cleaned up**", event->threadId);
+#if CEXCEPTION_MULTI_TASK
+		//by now the slot may be released or taken by another thread: the dead thread's line comes from the
+		//record, only the other threads from the registry
+		LOG(INFO, " Thread %u: %-15s @ 0x%08lx <<<<", event->threadId, event->name, (unsigned long)(uintptr_t)event->handle);
+		__cexception_dump_other_threads(event->handle);
+#endif
+		break;
+	case CEXCEPTION_EVENT_FAULT:
+		LOG(ERROR, "HARDWARE EXCEPTION CAUGHT in thread %u (%s @ 0x%08lx)", event->threadId, event->name, (unsigned long)(uintptr_t)event->handle);
+#ifndef CEXCEPTION_PLATFORM_HOST
+		LOG(ERROR, "r0   = 0x%08x", (unsigned int)event->data[0]);
+		LOG(ERROR, "r1   = 0x%08x", (unsigned int)event->data[1]);
+		LOG(ERROR, "r2   = 0x%08x", (unsigned int)event->data[2]);
+		LOG(ERROR, "r3   = 0x%08x", (unsigned int)event->data[3]);
+		LOG(ERROR, "r12  = 0x%08x", (unsigned int)event->data[4]);
+		LOG(ERROR, "lr   = 0x%08x", (unsigned int)event->data[5]);
+		LOG(ERROR, "pc   = 0x%08x", (unsigned int)event->data[6]);
+		LOG(ERROR, "psr  = 0x%08x", (unsigned int)event->data[7]);
+		LOG(ERROR, "hfsr = 0x%08x", (unsigned int)event->data[8]);
+		LOG(ERROR, "cfsr = 0x%08x", (unsigned int)event->data[9]);
+#if CEXCEPTION_FAULT_EXTENDED
+		for(unsigned int r = 4; r <= 11; r++)
+			LOG(ERROR, "r%-3u = 0x%08x", r, (unsigned int)event->data[10 + r - 4]);
+		LOG(ERROR, "sp   = 0x%08x", (unsigned int)event->data[18]);
+		LOG(ERROR, "mmfar= 0x%08x", (unsigned int)event->data[19]);
+		LOG(ERROR, "bfar = 0x%08x", (unsigned int)event->data[20]);
+		LOG(ERROR, "exc_return = 0x%08x", (unsigned int)event->data[21]);
+#endif
+#else
+		LOG(ERROR, "signal = %u, pc = 0x%08x, addr = 0x%08x", (unsigned int)event->data[7], (unsigned int)event->data[6], (unsigned int)event->data[9]);
+#if CEXCEPTION_FAULT_EXTENDED
+		LOG(ERROR, "sp = 0x%08x", (unsigned int)event->data[18]);
+#endif
+#endif
+		break;
+	default:
+		LOG(WARN, "Unknown exception event %u", event->type);
+		break;
+	}
+}
+
+extern "C" void __cexception_get_event_stats(CExceptionEventStats* stats) {
+	stats->posted = CExceptionEventsPosted.load();
+	stats->dropped = CExceptionEventsDropped.load();
+	stats->reported = CExceptionEventsReported.load();
+	stats->highWater = CExceptionEventsHighWater.load();
+}
+
+#if CEXCEPTION_MULTI_TASK
+static void __cexception_event_reporter(void* arg) {
+	for(;;)
+	{
+		__cexception_report_events();
+		delay(CEXCEPTION_EVENT_REPORTER_PERIOD);
+	}
+}
+
+extern "C" void __cexception_start_event_reporter() {
+	bool expected = false;
+	if(!CExceptionReporterRunning.compare_exchange_strong(expected, true))
+		return;
+
+	os_thread_t thread = nullptr;
+	os_thread_create(&thread, "cexception", OS_THREAD_PRIORITY_DEFAULT - 1, __cexception_event_reporter, nullptr, OS_THREAD_STACK_SIZE_DEFAULT);
+	if(thread == nullptr)
+	{
+		LOG(WARN, "Exception reporter thread not started, reporting synchronously");
+		CExceptionReporterRunning.store(false);
+	}
+}
+#else
+extern "C" void __cexception_start_event_reporter() {
+}
+#endif
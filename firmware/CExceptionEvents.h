@@ -0,0 +1,78 @@
+#ifndef _CEXCEPTION_EVENTS_H
+#define _CEXCEPTION_EVENTS_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Exception event queue.
+//
+//Faults and thread deaths are reported without formatting anything on the thread that failed: the thread fills
+//in a fixed-size record and posts it to a bounded lock-free MPSC ring, and a low-priority reporter thread
+//drains the ring and does the logging. Posting never blocks; when the ring is full the record is dropped and
+//counted. Until the reporter runs (it is started by the first NEW_THREAD, or by
+//__cexception_start_event_reporter()) and in single-task builds, records are drained on the posting thread
+//right away, which is the old synchronous behaviour.
+
+//ring capacity in records, a power of two
+#ifndef CEXCEPTION_EVENT_QUEUE_SIZE
+#define CEXCEPTION_EVENT_QUEUE_SIZE 8
+#endif
+#if CEXCEPTION_EVENT_QUEUE_SIZE & (CEXCEPTION_EVENT_QUEUE_SIZE - 1)
+#error "CEXCEPTION_EVENT_QUEUE_SIZE must be a power of two"
+#endif
+
+//how often the reporter thread looks for records (ms)
+#ifndef CEXCEPTION_EVENT_REPORTER_PERIOD
+#define CEXCEPTION_EVENT_REPORTER_PERIOD 10
+#endif
+
+#define CEXCEPTION_EVENT_NAME_LEN 16
+
+typedef enum {
+	CEXCEPTION_EVENT_THREAD_STARTED = 1,    //a NEW_THREAD thread is running
+	CEXCEPTION_EVENT_THREAD_DIED = 2,       //an exception left a NEW_THREAD thread, which has been terminated
+	CEXCEPTION_EVENT_FAULT = 3,             //hardware fault, data holds the fault record
+} CExceptionEventType;
+
+typedef struct {
+	uint8_t type;                           //CExceptionEventType
+	uint8_t reserved;
+	uint16_t threadId;                      //registry slot, 0 if not registered
+	CEXCEPTION_T exception;
+	uint32_t timestamp;                     //millis()
+	void* handle;
+	char name[CEXCEPTION_EVENT_NAME_LEN];   //copied when posted, the thread may be gone when it is reported
+	uint32_t data[CEXCEPTION_DATA_COUNT];   //CEXCEPTION_CURRENT_DATA of the thread for CEXCEPTION_EVENT_FAULT
+} CExceptionEvent;
+
+typedef struct {
+	uint32_t posted;                        //records accepted into the ring
+	uint32_t dropped;                       //records lost because the ring was full
+	uint32_t reported;                      //records handed to __cexception_report_event
+	uint32_t highWater;                     //most records ever waiting at once
+} CExceptionEventStats;
+
+//fill in the calling thread's id, handle, name and the timestamp, then post; returns false if dropped
+bool __cexception_post_event(CExceptionEventType type, CEXCEPTION_T exception, const uint32_t* data);
+
+//take the oldest record; returns false if the ring is empty
+bool __cexception_poll_event(CExceptionEvent* event);
+
+//poll and report every waiting record
+void __cexception_report_events();
+
+//formats one record to the log; weak, override it to ship records elsewhere
+void __cexception_report_event(const CExceptionEvent* event);
+
+void __cexception_start_event_reporter();
+void __cexception_get_event_stats(CExceptionEventStats* stats);
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_EVENTS_H
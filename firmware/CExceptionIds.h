@@ -0,0 +1,99 @@
+#ifndef _CEXCEPTION_IDS_H
+#define _CEXCEPTION_IDS_H
+
+#include <stddef.h>
+#include "CException.h"
+
+//Compile-time exception id registry (C++).
+//
+//Ids are CEXCEPTION_ID(category, code). Each component lists its categories and ids in constexpr tables and
+//checks them with CEXCEPTION_CHECK_CATEGORIES / CEXCEPTION_CHECK_IDS, which fail the build if a category or id
+//is defined twice, an id equals CEXCEPTION_NONE or uses a category that is not in the table. To check ids of
+//several components against each other, list them in one table.
+//
+//    constexpr cexception::Category categories[] = { { 0x0101, "net" }, { 0x0102, "storage" } };
+//    constexpr CEXCEPTION_T ids[] = { NET_TIMEOUT, NET_REFUSED, STORAGE_FULL };
+//    CEXCEPTION_CHECK_CATEGORIES(categories);
+//    CEXCEPTION_CHECK_IDS(ids, categories);
+
+namespace cexception {
+
+struct Category {
+	uint16_t id;
+	const char* name;
+};
+
+constexpr CEXCEPTION_T make_id(uint16_t category, uint16_t code) {
+	return CEXCEPTION_ID(category, code);
+}
+
+constexpr uint16_t category_of(CEXCEPTION_T id) {
+	return CEXCEPTION_CATEGORY_OF(id);
+}
+
+//true if no two entries in [i, N) are equal
+template<typename T, size_t N>
+constexpr bool all_distinct(const T (&values)[N], size_t i = 0, size_t j = 1) {
+	return i + 1 >= N ? true
+			: j >= N ? all_distinct(values, i + 1, i + 2)
+			: values[i] == values[j] ? false
+			: all_distinct(values, i, j + 1);
+}
+
+template<size_t N>
+constexpr bool categories_distinct(const Category (&categories)[N], size_t i = 0, size_t j = 1) {
+	return i + 1 >= N ? true
+			: j >= N ? categories_distinct(categories, i + 1, i + 2)
+			: categories[i].id == categories[j].id ? false
+			: categories_distinct(categories, i, j + 1);
+}
+
+template<size_t N>
+constexpr bool has_category(const Category (&categories)[N], uint16_t category, size_t i = 0) {
+	return i < N && (categories[i].id == category || has_category(categories, category, i + 1));
+}
+
+template<size_t N, size_t M>
+constexpr bool all_categorized(const CEXCEPTION_T (&ids)[N], const Category (&categories)[M], size_t i = 0) {
+	return i >= N || (has_category(categories, category_of(ids[i])) && all_categorized(ids, categories, i + 1));
+}
+
+template<size_t N>
+constexpr bool none_reserved(const CEXCEPTION_T (&ids)[N], size_t i = 0) {
+	return i >= N || (ids[i] != (CEXCEPTION_T)CEXCEPTION_NONE && none_reserved(ids, i + 1));
+}
+
+//name of the category of id, or null
+template<size_t N>
+constexpr const char* category_name(const Category (&categories)[N], CEXCEPTION_T id, size_t i = 0) {
+	return i >= N ? nullptr : categories[i].id == category_of(id) ? categories[i].name : category_name(categories, id, i + 1);
+}
+
+#define CEXCEPTION_CHECK_CATEGORIES(categories) \
+	static_assert(cexception::categories_distinct(categories), "duplicate exception category in " #categories)
+
+#define CEXCEPTION_CHECK_IDS(ids, categories) \
+	static_assert(cexception::all_distinct(ids), "duplicate exception id in " #ids); \
+	static_assert(cexception::none_reserved(ids), #ids " contains CEXCEPTION_NONE"); \
+	static_assert(cexception::all_categorized(ids, categories), #ids " uses a category missing from " #categories)
+
+//the library's own ids
+constexpr Category library_categories[] = {
+	{ CEXCEPTION_CATEGORY_LIBRARY, "cexception" },
+};
+
+constexpr CEXCEPTION_T library_ids[] = {
+	EXCEPTION_OUT_OF_MEM,
+	EXCEPTION_THREAD_START_FAILED,
+	EXCEPTION_TOO_MANY_THREADS,
+	EXCEPTION_INVALID_ARGUMENT,
+	EXCEPTION_CANCELLED,
+	EXCEPTION_HARDWARE,
+};
+
+CEXCEPTION_CHECK_CATEGORIES(library_categories);
+CEXCEPTION_CHECK_IDS(library_ids, library_categories);
+
+}
+
+#endif // _CEXCEPTION_IDS_H
@@ -0,0 +1,86 @@
+#include "CExceptionJmp.h"
+
+//Hand-written context save/restore for Try/Throw, see CExceptionJmp.h for the buffer layouts.
+//Both functions are leaf functions with no frame of their own: setjmp records the caller's SP and return
+//address as they will be after it returns, and longjmp restores them and returns into the Try as if
+//setjmp had returned `val` (forced to 1 if 0, as the C standard requires).
+
+#if CEXCEPTION_USE_FAST_JMP
+
+#if defined(__x86_64__)
+
+__asm__ (
+	"	.text                                   \n"
+	"	.globl __cexception_setjmp              \n"
+	"	.type __cexception_setjmp, @function    \n"
+	"__cexception_setjmp:                       \n"
+	"	movq %rbx, 0(%rdi)                      \n"
+	"	movq %rbp, 8(%rdi)                      \n"
+	"	movq %r12, 16(%rdi)                     \n"
+	"	movq %r13, 24(%rdi)                     \n"
+	"	movq %r14, 32(%rdi)                     \n"
+	"	movq %r15, 40(%rdi)                     \n"
+	"	leaq 8(%rsp), %rdx                      \n" //sp once we have returned
+	"	movq %rdx, 48(%rdi)                     \n"
+	"	movq (%rsp), %rdx                       \n" //return address
+	"	movq %rdx, 56(%rdi)                     \n"
+	"	xorl %eax, %eax                         \n"
+	"	ret                                     \n"
+	"	.size __cexception_setjmp, .-__cexception_setjmp \n"
+	"                                           \n"
+	"	.globl __cexception_longjmp             \n"
+	"	.type __cexception_longjmp, @function   \n"
+	"__cexception_longjmp:                      \n"
+	"	movq 0(%rdi), %rbx                      \n"
+	"	movq 8(%rdi), %rbp                      \n"
+	"	movq 16(%rdi), %r12                     \n"
+	"	movq 24(%rdi), %r13                     \n"
+	"	movq 32(%rdi), %r14                     \n"
+	"	movq 40(%rdi), %r15                     \n"
+	"	movl %esi, %eax                         \n"
+	"	testl %eax, %eax                        \n"
+	"	jnz 1f                                  \n"
+	"	incl %eax                               \n"
+	"1:	movq 48(%rdi), %rsp                     \n"
+	"	jmpq *56(%rdi)                          \n"
+	"	.size __cexception_longjmp, .-__cexception_longjmp \n"
+);
+
+#elif defined(__thumb2__)
+
+__asm__ (
+	"	.text                                   \n"
+	"	.syntax unified                         \n"
+	"	.thumb                                  \n"
+	"	.globl __cexception_setjmp              \n"
+	"	.type __cexception_setjmp, %function    \n"
+	"	.thumb_func                             \n"
+	"__cexception_setjmp:                       \n"
+	"	mov ip, sp                              \n" //sp cannot be in a Thumb-2 stm list
+	"	stmia r0!, {r4-r11, ip, lr}             \n"
+#if defined(__ARM_PCS_VFP)
+	"	vstmia r0!, {d8-d15}                    \n"
+#endif
+	"	movs r0, #0                             \n"
+	"	bx lr                                   \n"
+	"	.size __cexception_setjmp, .-__cexception_setjmp \n"
+	"                                           \n"
+	"	.globl __cexception_longjmp             \n"
+	"	.type __cexception_longjmp, %function   \n"
+	"	.thumb_func                             \n"
+	"__cexception_longjmp:                      \n"
+	"	ldmia r0!, {r4-r11, ip, lr}             \n"
+#if defined(__ARM_PCS_VFP)
+	"	vldmia r0!, {d8-d15}                    \n"
+#endif
+	"	mov sp, ip                              \n"
+	"	movs r0, r1                             \n"
+	"	it eq                                   \n"
+	"	moveq r0, #1                            \n"
+	"	bx lr                                   \n"
+	"	.size __cexception_longjmp, .-__cexception_longjmp \n"
+);
+
+#endif
+
+#endif
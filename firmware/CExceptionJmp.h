@@ -0,0 +1,61 @@
+#ifndef _CEXCEPTION_JMP_H
+#define _CEXCEPTION_JMP_H
+
+#include <setjmp.h>
+#include <stdint.h>
+
+//Context save/restore used by Try and Throw.
+//
+//A Try frame only needs what the callee-saved ABI guarantees: the callee-saved registers, SP and the
+//return address. libc setjmp saves more than that (newlib: FPU state on every target, glibc: pointer
+//mangling and optionally the signal mask), so on targets with a hand-written implementation in
+//CExceptionJmp.cpp the smaller primitive is used instead:
+//  ARMv7-M (Thumb-2): r4-r11, sp, lr (+ d8-d15 with the hard-float ABI) = 40 bytes (104 bytes)
+//  x86-64 (SysV):     rbx, rbp, r12-r15, rsp, return address          = 64 bytes
+//Define CEXCEPTION_USE_FAST_JMP to 0 to force libc setjmp/longjmp. The setting must be the same for
+//the library and every translation unit that uses Try.
+
+#ifndef CEXCEPTION_USE_FAST_JMP
+#if defined(__x86_64__) || ((defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)) && defined(__thumb2__))
+#define CEXCEPTION_USE_FAST_JMP 1
+#else
+#define CEXCEPTION_USE_FAST_JMP 0
+#endif
+#endif
+
+#if CEXCEPTION_USE_FAST_JMP
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#if defined(__x86_64__)
+#define CEXCEPTION_JMP_WORDS 8
+#elif defined(__ARM_PCS_VFP)
+#define CEXCEPTION_JMP_WORDS (10 + 16)
+#else
+#define CEXCEPTION_JMP_WORDS 10
+#endif
+
+typedef uintptr_t CEXCEPTION_JMP_BUF[CEXCEPTION_JMP_WORDS];
+
+int __cexception_setjmp(CEXCEPTION_JMP_BUF env) __attribute__((returns_twice, nothrow));
+void __cexception_longjmp(CEXCEPTION_JMP_BUF env, int val) __attribute__((noreturn, nothrow));
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#define CEXCEPTION_SETJMP(env) __cexception_setjmp(env)
+#define CEXCEPTION_LONGJMP(env, val) __cexception_longjmp(env, val)
+
+#else
+
+typedef jmp_buf CEXCEPTION_JMP_BUF;
+#define CEXCEPTION_SETJMP(env) setjmp(env)
+#define CEXCEPTION_LONGJMP(env, val) longjmp(env, val)
+
+#endif
+
+#endif // _CEXCEPTION_JMP_H
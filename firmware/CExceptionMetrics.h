@@ -0,0 +1,61 @@
+#ifndef _CEXCEPTION_METRICS_H
+#define _CEXCEPTION_METRICS_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Runtime metrics (CEXCEPTION_METRICS=1).
+//
+//Each thread counts its own Try entries, throws and catches, plus a histogram of the time from Throw to the
+//Catch that handled it. Counters live in the thread's exception context and have a single writer, so the hot
+//path is a plain increment (Try entry is counted inline in the Try macro, everything else on the throw path).
+//Throws are also counted per exception id in a small shared table; ids that do not fit are counted together.
+//Readers take no locks: a snapshot may be a few events behind a thread that is running, but counters never go
+//backwards. When a slot is reused, the counts of the thread that owned it move to a retired total, so the
+//aggregate stays monotonic.
+//
+//Threads that are not registered share slot 0 and may lose counts when they race.
+
+//number of exception ids counted individually
+#ifndef CEXCEPTION_METRICS_IDS
+#define CEXCEPTION_METRICS_IDS 16
+#endif
+
+//latency bucket i counts throw-to-catch times below 2^i microseconds, the last bucket everything longer
+#define CEXCEPTION_METRICS_LATENCY_BUCKETS 12
+
+typedef struct {
+	uint32_t tries;
+	uint32_t throws;
+	uint32_t catches;
+	uint32_t latency[CEXCEPTION_METRICS_LATENCY_BUCKETS];
+} CExceptionThreadMetrics;
+
+typedef struct {
+	CEXCEPTION_T id;
+	uint32_t throws;
+} CExceptionIdMetrics;
+
+typedef struct {
+	uint32_t timestamp;                             //millis() when the snapshot was taken
+	unsigned int threads;                           //slots with a registered thread
+	CExceptionThreadMetrics total;                  //all slots, including retired threads
+	CExceptionIdMetrics ids[CEXCEPTION_METRICS_IDS];//CEXCEPTION_NONE marks an unused entry
+	uint32_t otherIdThrows;                         //throws of ids that did not fit in ids
+} CExceptionMetricsSnapshot;
+
+//aggregate over every slot
+void __cexception_metrics_snapshot(CExceptionMetricsSnapshot* snapshot);
+
+//counters of one slot since it was last (re)registered; returns false if the slot does not exist
+bool __cexception_thread_metrics(unsigned int id, CExceptionThreadMetrics* metrics);
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_METRICS_H
@@ -0,0 +1,110 @@
+#include "CExceptionParallel.h"
+#include "application.h"
+#include <string.h>
+#include <atomic>
+
+#if CEXCEPTION_MULTI_TASK
+
+//Lives on the calling thread's stack. Every runner (one pool task per worker, plus the caller) claims chunks by
+//number until there are none left or the loop is cancelled; the caller returns only after the last runner has
+//left, so a runner never sees a stale loop.
+struct CExceptionParallel {
+	uint32_t begin;
+	uint32_t end;
+	uint32_t grain;
+	uint32_t chunks;
+	void (*body)(const CExceptionRange*, void*);
+	void* arg;
+	std::atomic<uint32_t> next;             //next chunk to claim
+	std::atomic<bool> cancelled;
+	std::atomic<unsigned int> running;      //runners that have not left
+	CEXCEPTION_T exception;                 //first failure, written once by the runner that sets cancelled
+	uint32_t data[CEXCEPTION_DATA_COUNT];
+	std::atomic<bool> failed;
+};
+
+static void __cexception_parallel_fail(CExceptionParallel* loop, CEXCEPTION_T e) {
+	//checkpoints of the other runners, once the loop is cancelled
+	if(e == EXCEPTION_CANCELLED && loop->cancelled.load(std::memory_order_relaxed))
+		return;
+	if(loop->failed.exchange(true, std::memory_order_relaxed))
+		return;
+	loop->exception = e;
+	memcpy(loop->data, CEXCEPTION_CURRENT_DATA, sizeof(loop->data));
+	loop->cancelled.store(true, std::memory_order_relaxed);
+}
+
+static void __cexception_parallel_runner(void* arg) {
+	CExceptionParallel* loop = (CExceptionParallel*)arg;
+	CExceptionRange range;
+	range.loop = loop;
+
+	CEXCEPTION_T e;
+	Try {
+		while(!loop->cancelled.load(std::memory_order_relaxed))
+		{
+			uint32_t chunk = loop->next.fetch_add(1, std::memory_order_relaxed);
+			if(chunk >= loop->chunks)
+				break;
+			range.begin = loop->begin + chunk * loop->grain;
+			range.end = loop->end - range.begin > loop->grain ? range.begin + loop->grain : loop->end;
+			loop->body(&range, loop->arg);
+		}
+	} Catch(e) {
+		__cexception_parallel_fail(loop, e);
+	}
+	loop->running.fetch_sub(1, std::memory_order_release);
+}
+
+extern "C" bool __cexception_parallel_cancelled(const CExceptionRange* range) {
+	return range->loop->cancelled.load(std::memory_order_relaxed);
+}
+
+extern "C" void __cexception_parallel_for(CExceptionPool* pool, uint32_t begin, uint32_t end, uint32_t grain,
+		void(*body)(const CExceptionRange* range, void* arg), void* arg) {
+	if(end <= begin)
+		return;
+	if(grain == 0)
+		grain = 1;
+
+	CExceptionParallel loop;
+	loop.begin = begin;
+	loop.end = end;
+	loop.grain = grain;
+	loop.chunks = (uint32_t)(((uint64_t)end - begin + grain - 1) / grain);
+	loop.body = body;
+	loop.arg = arg;
+	loop.next.store(0, std::memory_order_relaxed);
+	loop.cancelled.store(false, std::memory_order_relaxed);
+	loop.failed.store(false, std::memory_order_relaxed);
+	loop.exception = CEXCEPTION_NONE;
+
+	//the caller takes chunks as well, so one chunk needs no worker
+	unsigned int helpers = __cexception_pool_workers(pool);
+	if(helpers > loop.chunks - 1)
+		helpers = loop.chunks - 1;
+	loop.running.store(helpers + 1, std::memory_order_relaxed);
+	for(unsigned int i = 0; i < helpers; i++)
+		__cexception_pool_submit(pool, __cexception_parallel_runner, &loop, nullptr);
+
+	__cexception_parallel_runner(&loop);
+
+	//a worker waiting here keeps the pool going, runners may be queued behind this very task
+	for(unsigned int spins = 0; loop.running.load(std::memory_order_acquire); spins++)
+	{
+		if(__cexception_pool_run_one(pool))
+			spins = 0;
+		else if(spins < CEXCEPTION_POOL_SPINS)
+			os_thread_yield();
+		else
+			delay(1);
+	}
+
+	if(loop.failed.load(std::memory_order_relaxed))
+	{
+		memcpy(CEXCEPTION_CURRENT_DATA, loop.data, sizeof(loop.data));
+		Throw(loop.exception);
+	}
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _CEXCEPTION_PARALLEL_H
+#define _CEXCEPTION_PARALLEL_H
+
+#include "CExceptionPool.h"
+#ifdef __cplusplus
+#include <mutex>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Parallel loops on a worker pool.
+//
+//__cexception_parallel_for splits [begin, end) into chunks of grain indices and runs body on them on the
+//pool's workers and on the calling thread, which takes chunks too. The first exception that leaves a chunk
+//cancels the loop: no further chunks are started, and chunks that are running stop at their next
+//CEXCEPTION_CHECKPOINT. Once every chunk has stopped, the id is thrown again in the calling thread, with the
+//failing thread's CEXCEPTION_CURRENT_DATA (the fault record after a hardware fault) copied to the caller's.
+//A worker of the pool may start a loop on the same pool; it runs other queued tasks while it waits.
+
+#if CEXCEPTION_MULTI_TASK
+
+typedef struct CExceptionParallel CExceptionParallel;
+
+//the chunk a body call works on
+typedef struct {
+	uint32_t begin;
+	uint32_t end;
+	CExceptionParallel* loop;
+} CExceptionRange;
+
+void __cexception_parallel_for(CExceptionPool* pool, uint32_t begin, uint32_t end, uint32_t grain,
+		void(*body)(const CExceptionRange* range, void* arg), void* arg);
+
+//whether another chunk of range's loop has failed
+bool __cexception_parallel_cancelled(const CExceptionRange* range);
+
+//throw EXCEPTION_CANCELLED if the loop has been cancelled; call it between units of work in long chunks
+#define CEXCEPTION_CHECKPOINT(range) do { if(__cexception_parallel_cancelled(range)) Throw(EXCEPTION_CANCELLED); } while(0)
+
+#endif
+
+#ifdef __cplusplus
+}   // extern "C"
+
+#if CEXCEPTION_MULTI_TASK
+namespace cexception {
+
+//body(const CExceptionRange*) for every chunk
+template<typename Body>
+void parallel_for(CExceptionPool* pool, uint32_t begin, uint32_t end, uint32_t grain, Body&& body) {
+	typedef typename std::remove_reference<Body>::type BodyType;
+	__cexception_parallel_for(pool, begin, end, grain, [](const CExceptionRange* range, void* arg) {
+		(*static_cast<BodyType*>(arg))(range);
+	}, &body);
+}
+
+//combine(identity, body(range)) over every chunk, in no particular order; combine must be associative and
+//commutative and must not throw
+template<typename T, typename Body, typename Combine>
+T parallel_reduce(CExceptionPool* pool, uint32_t begin, uint32_t end, uint32_t grain, T identity, Body&& body, Combine&& combine) {
+	T result = identity;
+	std::mutex lock;
+	parallel_for(pool, begin, end, grain, [&](const CExceptionRange* range) {
+		T partial = body(range);
+		BEGIN_LOCK_SAFE(lock)
+		{
+			result = combine(result, partial);
+		} END_LOCK_SAFE();
+	});
+	return result;
+}
+
+}
+#endif
+#endif
+
+#endif // _CEXCEPTION_PARALLEL_H
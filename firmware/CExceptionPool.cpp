@@ -0,0 +1,335 @@
+#include "CExceptionPool.h"
+#include "application.h"
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include "logging.h"
+
+LOG_SOURCE_CATEGORY("cexception");
+
+#if CEXCEPTION_MULTI_TASK
+
+struct CExceptionTask {
+	void (*func)(void*);
+	void* arg;
+	void (*cb)(CEXCEPTION_T, CExceptionThreadInfo*);
+};
+
+//A deque entry can be read by a thief while the owner reuses it (the thief's CAS on top then fails and the copy
+//is dropped), so its fields are atomics read and written relaxed.
+struct CExceptionTaskSlot {
+	std::atomic<void (*)(void*)> func;
+	std::atomic<void*> arg;
+	std::atomic<void (*)(CEXCEPTION_T, CExceptionThreadInfo*)> cb;
+
+	void store(const CExceptionTask& task) {
+		func.store(task.func, std::memory_order_relaxed);
+		arg.store(task.arg, std::memory_order_relaxed);
+		cb.store(task.cb, std::memory_order_relaxed);
+	}
+
+	void load(CExceptionTask* task) const {
+		task->func = func.load(std::memory_order_relaxed);
+		task->arg = arg.load(std::memory_order_relaxed);
+		task->cb = cb.load(std::memory_order_relaxed);
+	}
+};
+
+//Bounded Chase-Lev deque (with the fences of Le et al., "Correct and efficient work-stealing for weak memory
+//models"). The owner pushes and pops at bottom, thieves take from top; the last task is settled by a CAS on top.
+//Positions are free-running 32-bit counters.
+//Thieves write top and the owner writes bottom and victim, so each group has a cache line of its own; pool and
+//handle, read by every thread that submits, share one that nobody writes once the pool is running.
+struct alignas(CEXCEPTION_CACHE_LINE) CExceptionWorker {
+	std::atomic<uint32_t> top;
+	alignas(CEXCEPTION_CACHE_LINE) std::atomic<uint32_t> bottom;
+	uint32_t victim;                            //next worker to steal from
+	CExceptionTaskSlot slots[CEXCEPTION_POOL_DEQUE_SIZE];
+	alignas(CEXCEPTION_CACHE_LINE) CExceptionPool* pool;
+	std::atomic<void*> handle;                  //stored once the worker's thread has been started
+};
+
+struct CExceptionQueueCell {
+	std::atomic<uint32_t> sequence;
+	CExceptionTask task;
+};
+
+struct CExceptionPool {
+	//shared queue for tasks from other threads, the bounded MPMC ring of CExceptionEvents.cpp
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	CExceptionQueueCell cells[CEXCEPTION_POOL_QUEUE_SIZE];
+
+	std::atomic<uint32_t> pending;      //submitted and not finished
+	std::atomic<uint32_t> submitted;
+	std::atomic<uint32_t> completed;
+	std::atomic<uint32_t> failed;
+	std::atomic<uint32_t> stolen;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned int> running;  //workers that have not left their loop
+	unsigned int workerCount;
+	CExceptionWorker* workers;
+};
+
+static bool __cexception_deque_push(CExceptionWorker* worker, const CExceptionTask& task) {
+	uint32_t b = worker->bottom.load(std::memory_order_relaxed);
+	uint32_t t = worker->top.load(std::memory_order_acquire);
+	if(b - t >= CEXCEPTION_POOL_DEQUE_SIZE)
+		return false;
+	worker->slots[b & (CEXCEPTION_POOL_DEQUE_SIZE - 1)].store(task);
+	std::atomic_thread_fence(std::memory_order_release);
+	worker->bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+static bool __cexception_deque_pop(CExceptionWorker* worker, CExceptionTask* task) {
+	uint32_t b = worker->bottom.load(std::memory_order_relaxed) - 1;
+	worker->bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint32_t t = worker->top.load(std::memory_order_relaxed);
+	if((int32_t)(b - t) < 0)
+	{
+		worker->bottom.store(b + 1, std::memory_order_relaxed);
+		return false;
+	}
+	worker->slots[b & (CEXCEPTION_POOL_DEQUE_SIZE - 1)].load(task);
+	if(b != t)
+		return true;
+	//last task: race the thieves for it
+	bool won = worker->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	worker->bottom.store(b + 1, std::memory_order_relaxed);
+	return won;
+}
+
+static bool __cexception_deque_steal(CExceptionWorker* worker, CExceptionTask* task) {
+	uint32_t t = worker->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint32_t b = worker->bottom.load(std::memory_order_acquire);
+	if((int32_t)(b - t) <= 0)
+		return false;
+	worker->slots[t & (CEXCEPTION_POOL_DEQUE_SIZE - 1)].load(task);
+	return worker->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+//Sequences are stored relative to the cell index, as in the event ring, so a zeroed queue is empty.
+static bool __cexception_queue_push(CExceptionPool* pool, const CExceptionTask& task) {
+	uint32_t pos = pool->head.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		CExceptionQueueCell& cell = pool->cells[pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)];
+		int32_t diff = (int32_t)(cell.sequence.load(std::memory_order_acquire) + (pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)) - pos);
+		if(diff == 0)
+		{
+			if(pool->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.task = task;
+				cell.sequence.store(pos + 1 - (pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)), std::memory_order_release);
+				return true;
+			}
+		}
+		else if(diff < 0)
+			return false;
+		else
+			pos = pool->head.load(std::memory_order_relaxed);
+	}
+}
+
+static bool __cexception_queue_pop(CExceptionPool* pool, CExceptionTask* task) {
+	uint32_t pos = pool->tail.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		CExceptionQueueCell& cell = pool->cells[pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)];
+		int32_t diff = (int32_t)(cell.sequence.load(std::memory_order_acquire) + (pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)) - (pos + 1));
+		if(diff == 0)
+		{
+			if(pool->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				*task = cell.task;
+				cell.sequence.store(pos + CEXCEPTION_POOL_QUEUE_SIZE - (pos & (CEXCEPTION_POOL_QUEUE_SIZE - 1)), std::memory_order_release);
+				return true;
+			}
+		}
+		else if(diff < 0)
+			return false;
+		else
+			pos = pool->tail.load(std::memory_order_relaxed);
+	}
+}
+
+//the worker of pool running on the calling thread, or null
+static CExceptionWorker* __cexception_pool_current_worker(CExceptionPool* pool) {
+	for(unsigned int i = 0; i < pool->workerCount; i++)
+		if(os_thread_is_current(pool->workers[i].handle.load(std::memory_order_acquire)))
+			return &pool->workers[i];
+	return nullptr;
+}
+
+static bool __cexception_pool_find_task(CExceptionPool* pool, CExceptionWorker* self, CExceptionTask* task) {
+	if(__cexception_deque_pop(self, task) || __cexception_queue_pop(pool, task))
+		return true;
+	for(unsigned int i = 1; i < pool->workerCount; i++)
+	{
+		CExceptionWorker* victim = &pool->workers[self->victim++ % pool->workerCount];
+		if(victim != self && __cexception_deque_steal(victim, task))
+		{
+			pool->stolen.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void __cexception_pool_run(CExceptionPool* pool, CExceptionThreadInfo* info, const CExceptionTask* task) {
+	CEXCEPTION_T e;
+	Try {
+		task->func(task->arg);
+	} Catch(e) {
+		pool->failed.fetch_add(1, std::memory_order_relaxed);
+		if(task->cb)
+			task->cb(e, info);
+	}
+	pool->completed.fetch_add(1, std::memory_order_relaxed);
+	pool->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void __cexception_pool_worker(void* arg) {
+	CExceptionWorker* self = (CExceptionWorker*)arg;
+	CExceptionPool* pool = self->pool;
+	CExceptionThreadInfo* info = __cexception_get_current_thread_info();
+
+	CExceptionTask task;
+	unsigned int idle = 0;
+	for(;;)
+	{
+		if(__cexception_pool_find_task(pool, self, &task))
+		{
+			idle = 0;
+			__cexception_pool_run(pool, info, &task);
+		}
+		else if(pool->stopping.load(std::memory_order_acquire))
+			break;
+		else if(++idle < CEXCEPTION_POOL_SPINS)
+			os_thread_yield();
+		else
+			delay(1);
+	}
+	//the pool may be freed from here on
+	pool->running.fetch_sub(1, std::memory_order_release);
+}
+
+static void __cexception_pool_free(CExceptionPool* pool) {
+	pool->stopping.store(true, std::memory_order_release);
+	while(pool->running.load(std::memory_order_acquire))
+		delay(1);
+	for(unsigned int i = 0; i < pool->workerCount; i++)
+		pool->workers[i].~CExceptionWorker();
+	pool->~CExceptionPool();
+	free(pool);
+}
+
+extern "C" CExceptionPool* __cexception_pool_create(const char* name, unsigned int workers, unsigned int priority, unsigned int stack_size) {
+	if(workers == 0)
+		Throw(EXCEPTION_INVALID_ARGUMENT);
+	//the pool at the start of the block, the workers after it on the next cache line
+	void* block = malloc(sizeof(CExceptionPool) + CEXCEPTION_CACHE_LINE - 1 + workers * sizeof(CExceptionWorker));
+	if(!block)
+		Throw(EXCEPTION_OUT_OF_MEM);
+
+	CExceptionPool* pool = new (block) CExceptionPool();
+	pool->workers = (CExceptionWorker*)(((uintptr_t)(pool + 1) + CEXCEPTION_CACHE_LINE - 1) & ~(uintptr_t)(CEXCEPTION_CACHE_LINE - 1));
+	for(unsigned int i = 0; i < workers; i++)
+	{
+		new (&pool->workers[i]) CExceptionWorker();
+		pool->workers[i].pool = pool;
+		pool->workers[i].victim = i + 1;
+	}
+
+	//a worker that has not started yet just has an empty deque to steal from. NEW_THREAD may store the handle
+	//after the thread is already running, so it is taken in a local and published from here; every handle is
+	//in place before the pool is returned, and so before any task can look for its worker.
+	pool->workerCount = workers;
+	pool->running.store(workers);
+	volatile unsigned int started = 0;
+	CEXCEPTION_T e;
+	Try {
+		for(; started < workers; started++)
+		{
+			os_thread_t thread = nullptr;
+			NEW_THREAD(&thread, name, priority, __cexception_pool_worker, &pool->workers[started], stack_size, nullptr);
+			pool->workers[started].handle.store(thread, std::memory_order_release);
+		}
+	} Catch(e) {
+		pool->running.fetch_sub(workers - started);
+		__cexception_pool_free(pool);
+		Throw(e);
+	}
+	return pool;
+}
+
+extern "C" bool __cexception_pool_try_submit(CExceptionPool* pool, void(*fun)(void*), void* arg, void(*cb)(CEXCEPTION_T, CExceptionThreadInfo*)) {
+	CExceptionTask task = { fun, arg, cb };
+	CExceptionWorker* self = __cexception_pool_current_worker(pool);
+
+	//counted before it is visible, so that wait() cannot miss it
+	pool->pending.fetch_add(1, std::memory_order_relaxed);
+	if((self && __cexception_deque_push(self, task)) || __cexception_queue_push(pool, task))
+	{
+		pool->submitted.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	pool->pending.fetch_sub(1, std::memory_order_relaxed);
+	return false;
+}
+
+extern "C" void __cexception_pool_submit(CExceptionPool* pool, void(*fun)(void*), void* arg, void(*cb)(CEXCEPTION_T, CExceptionThreadInfo*)) {
+	while(!__cexception_pool_try_submit(pool, fun, arg, cb))
+	{
+		if(__cexception_pool_current_worker(pool))
+		{
+			//waiting could deadlock the pool if every worker did it
+			CExceptionTask task = { fun, arg, cb };
+			pool->pending.fetch_add(1, std::memory_order_relaxed);
+			pool->submitted.fetch_add(1, std::memory_order_relaxed);
+			__cexception_pool_run(pool, __cexception_get_current_thread_info(), &task);
+			return;
+		}
+		os_thread_yield();
+	}
+}
+
+extern "C" void __cexception_pool_wait(CExceptionPool* pool) {
+	for(unsigned int spins = 0; pool->pending.load(std::memory_order_acquire); spins++)
+	{
+		if(spins < CEXCEPTION_POOL_SPINS)
+			os_thread_yield();
+		else
+			delay(1);
+	}
+}
+
+extern "C" void __cexception_pool_destroy(CExceptionPool* pool) {
+	__cexception_pool_wait(pool);
+	__cexception_pool_free(pool);
+}
+
+extern "C" void __cexception_pool_stats(CExceptionPool* pool, CExceptionPoolStats* stats) {
+	stats->submitted = pool->submitted.load(std::memory_order_relaxed);
+	stats->completed = pool->completed.load(std::memory_order_relaxed);
+	stats->failed = pool->failed.load(std::memory_order_relaxed);
+	stats->stolen = pool->stolen.load(std::memory_order_relaxed);
+}
+
+extern "C" unsigned int __cexception_pool_workers(CExceptionPool* pool) {
+	return pool->workerCount;
+}
+
+extern "C" bool __cexception_pool_run_one(CExceptionPool* pool) {
+	CExceptionWorker* self = __cexception_pool_current_worker(pool);
+	CExceptionTask task;
+	if(!self || !__cexception_pool_find_task(pool, self, &task))
+		return false;
+	__cexception_pool_run(pool, __cexception_get_current_thread_info(), &task);
+	return true;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _CEXCEPTION_POOL_H
+#define _CEXCEPTION_POOL_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Worker pool.
+//
+//A pool is a fixed set of NEW_THREAD workers that run short tasks, so a job costs a queue push instead of a
+//thread start, registration and teardown. Each worker owns a work-stealing deque: tasks submitted from a worker
+//go to the bottom of its own deque, and a worker that runs dry takes from the shared queue (where tasks from
+//other threads arrive) and then steals from the top of the other workers' deques. Each task runs in its own
+//Try. An exception that leaves a task is passed to the task's callback together with the worker's thread info,
+//the same callback a NEW_THREAD thread gets, and the worker then goes on with its next task.
+//
+//Nothing is allocated per task; the pool and its queues are allocated once by __cexception_pool_create. Every
+//worker takes a registry slot. Idle workers poll CEXCEPTION_POOL_SPINS times, yielding in between, and then
+//sleep 1 ms between polls.
+
+#if CEXCEPTION_MULTI_TASK
+
+//tasks each worker's deque holds, a power of two
+#ifndef CEXCEPTION_POOL_DEQUE_SIZE
+#define CEXCEPTION_POOL_DEQUE_SIZE 64
+#endif
+#if CEXCEPTION_POOL_DEQUE_SIZE & (CEXCEPTION_POOL_DEQUE_SIZE - 1)
+#error "CEXCEPTION_POOL_DEQUE_SIZE must be a power of two"
+#endif
+
+//tasks the shared queue holds, a power of two
+#ifndef CEXCEPTION_POOL_QUEUE_SIZE
+#define CEXCEPTION_POOL_QUEUE_SIZE 64
+#endif
+#if CEXCEPTION_POOL_QUEUE_SIZE & (CEXCEPTION_POOL_QUEUE_SIZE - 1)
+#error "CEXCEPTION_POOL_QUEUE_SIZE must be a power of two"
+#endif
+
+//polls (with a yield in between) an idle worker makes before it starts sleeping
+#ifndef CEXCEPTION_POOL_SPINS
+#define CEXCEPTION_POOL_SPINS 64
+#endif
+
+typedef struct CExceptionPool CExceptionPool;
+
+typedef struct {
+	uint32_t submitted;
+	uint32_t completed;     //including failed
+	uint32_t failed;        //left by an exception
+	uint32_t stolen;        //taken from another worker's deque
+} CExceptionPoolStats;
+
+//start workers threads; throws like NEW_THREAD if one cannot be started (the others are stopped again)
+CExceptionPool* __cexception_pool_create(const char* name, unsigned int workers, unsigned int priority, unsigned int stack_size);
+
+//queue fun(arg). If an exception leaves fun, cb (may be null) gets it with the worker's thread info; cb must not
+//throw. When the queue is full, a worker of the pool runs the task itself and any other thread waits for room.
+void __cexception_pool_submit(CExceptionPool* pool, void(*fun)(void*), void* arg, void(*cb)(CEXCEPTION_T, CExceptionThreadInfo*));
+
+//the same, but returns false instead of waiting when the queue is full
+bool __cexception_pool_try_submit(CExceptionPool* pool, void(*fun)(void*), void* arg, void(*cb)(CEXCEPTION_T, CExceptionThreadInfo*));
+
+//wait until every task submitted so far has finished; not from a worker of the pool
+void __cexception_pool_wait(CExceptionPool* pool);
+
+//wait for the tasks, stop the workers and free the pool
+void __cexception_pool_destroy(CExceptionPool* pool);
+
+void __cexception_pool_stats(CExceptionPool* pool, CExceptionPoolStats* stats);
+
+unsigned int __cexception_pool_workers(CExceptionPool* pool);
+
+//called on a worker of pool: run one task from its deque, the shared queue or another worker's deque, for a
+//worker that waits on other tasks of the pool; false if there was none (or the caller is not a worker of pool)
+bool __cexception_pool_run_one(CExceptionPool* pool);
+
+#define NEW_POOL(name, workers, priority, stackSize) __cexception_pool_create(name, workers, priority, stackSize)
+#define POOL_SUBMIT(pool, taskFunction, taskArg, exceptionCallback) __cexception_pool_submit(pool, taskFunction, taskArg, exceptionCallback)
+
+#endif
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_POOL_H
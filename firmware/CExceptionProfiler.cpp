@@ -0,0 +1,115 @@
+#include "CExceptionProfiler.h"
+#include "application.h"
+#include <string.h>
+#include <atomic>
+#include "logging.h"
+
+LOG_SOURCE_CATEGORY("cexception");
+
+#if CEXCEPTION_PROFILE_SITES
+
+//Open addressing on the site address. An entry is claimed by CAS on its key and keeps that site until reset;
+//file and line are filled in by the claiming thread right after, so a reader may briefly see them empty.
+
+struct CExceptionProfileEntry {
+	std::atomic<uintptr_t> site;
+	std::atomic<uint32_t> samples;
+	const char* volatile file;
+	volatile uint32_t line;
+};
+
+static CExceptionProfileEntry CExceptionProfile[CEXCEPTION_PROFILE_SITES];
+static std::atomic<uint32_t> CExceptionProfileThrows(0);
+static std::atomic<uint32_t> CExceptionProfileSamples(0);
+static std::atomic<uint32_t> CExceptionProfileUntracked(0);
+
+extern "C" void __cexception_profile_throw(const void* site, const char* file, uint32_t line) {
+	if(CExceptionProfileThrows.fetch_add(1, std::memory_order_relaxed) & (CEXCEPTION_PROFILE_SAMPLE_RATE - 1))
+		return;
+	CExceptionProfileSamples.fetch_add(1, std::memory_order_relaxed);
+
+	uintptr_t key = (uintptr_t)site;
+	unsigned int i = (unsigned int)(((key >> 1) * 2654435769u) >> 8) & (CEXCEPTION_PROFILE_SITES - 1);
+	for(unsigned int probes = 0; probes < CEXCEPTION_PROFILE_SITES; probes++, i = (i + 1) & (CEXCEPTION_PROFILE_SITES - 1))
+	{
+		CExceptionProfileEntry& entry = CExceptionProfile[i];
+		uintptr_t k = entry.site.load(std::memory_order_relaxed);
+		if(k == 0 && entry.site.compare_exchange_strong(k, key, std::memory_order_relaxed))
+		{
+			entry.file = file;
+			entry.line = line;
+			k = key;
+		}
+		if(k == key)
+		{
+			entry.samples.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+	CExceptionProfileUntracked.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" unsigned int __cexception_hot_throw_sites(CExceptionThrowSite* sites, unsigned int max) {
+	unsigned int count = 0;
+	for(unsigned int i = 0; i < CEXCEPTION_PROFILE_SITES; i++)
+	{
+		CExceptionThrowSite s;
+		s.site = (const void*)CExceptionProfile[i].site.load(std::memory_order_relaxed);
+		s.samples = CExceptionProfile[i].samples.load(std::memory_order_relaxed);
+		if(s.site == nullptr || s.samples == 0)
+			continue;
+		s.file = CExceptionProfile[i].file;
+		s.line = CExceptionProfile[i].line;
+
+		//insertion into the top-max list, most samples first
+		unsigned int j = count < max ? count++ : max;
+		while(j > 0 && sites[j - 1].samples < s.samples)
+		{
+			if(j < max)
+				sites[j] = sites[j - 1];
+			j--;
+		}
+		if(j < max)
+			sites[j] = s;
+	}
+	return count;
+}
+
+extern "C" void __cexception_profile_totals(uint32_t* samples, uint32_t* untracked) {
+	if(samples)
+		*samples = CExceptionProfileSamples.load(std::memory_order_relaxed);
+	if(untracked)
+		*untracked = CExceptionProfileUntracked.load(std::memory_order_relaxed);
+}
+
+extern "C" void __cexception_log_hot_throw_sites(unsigned int max) {
+	CExceptionThrowSite sites[CEXCEPTION_PROFILE_SITES];
+	if(max > CEXCEPTION_PROFILE_SITES)
+		max = CEXCEPTION_PROFILE_SITES;
+	unsigned int count = __cexception_hot_throw_sites(sites, max);
+	uint32_t samples, untracked;
+	__cexception_profile_totals(&samples, &untracked);
+
+	LOG(INFO, "Hot throw sites (%lu samples, %lu untracked, 1 in %u throws):", (unsigned long)samples, (unsigned long)untracked, CEXCEPTION_PROFILE_SAMPLE_RATE);
+	for(unsigned int i = 0; i < count; i++)
+	{
+		if(sites[i].file)
+			LOG(INFO, " %8lu  0x%08lx  %s:%lu", (unsigned long)sites[i].samples, (unsigned long)(uintptr_t)sites[i].site, sites[i].file, (unsigned long)sites[i].line);
+		else
+			LOG(INFO, " %8lu  0x%08lx", (unsigned long)sites[i].samples, (unsigned long)(uintptr_t)sites[i].site);
+	}
+}
+
+extern "C" void __cexception_profile_reset() {
+	for(unsigned int i = 0; i < CEXCEPTION_PROFILE_SITES; i++)
+	{
+		CExceptionProfile[i].samples.store(0, std::memory_order_relaxed);
+		CExceptionProfile[i].file = nullptr;
+		CExceptionProfile[i].line = 0;
+		CExceptionProfile[i].site.store(0, std::memory_order_relaxed);
+	}
+	CExceptionProfileSamples.store(0);
+	CExceptionProfileUntracked.store(0);
+}
+
+#endif
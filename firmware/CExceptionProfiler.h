@@ -0,0 +1,64 @@
+#ifndef _CEXCEPTION_PROFILER_H
+#define _CEXCEPTION_PROFILER_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Hot throw-site profiler.
+//
+//Every CEXCEPTION_PROFILE_SAMPLE_RATE-th Throw (across all threads) adds one sample to a fixed table keyed by
+//throw site, so code that throws in a loop, and pays for the unwinding every time, shows up at the top. The
+//table holds CEXCEPTION_PROFILE_SITES sites; samples of sites that arrive once it is full are only counted in
+//total. Nothing is allocated and the table is never locked.
+
+//sites tracked, a power of two; 0 compiles the profiler out
+#ifndef CEXCEPTION_PROFILE_SITES
+#define CEXCEPTION_PROFILE_SITES 0
+#endif
+#if CEXCEPTION_PROFILE_SITES & (CEXCEPTION_PROFILE_SITES - 1)
+#error "CEXCEPTION_PROFILE_SITES must be a power of two"
+#endif
+
+//sample one throw in this many, a power of two
+#ifndef CEXCEPTION_PROFILE_SAMPLE_RATE
+#define CEXCEPTION_PROFILE_SAMPLE_RATE 1
+#endif
+#if CEXCEPTION_PROFILE_SAMPLE_RATE & (CEXCEPTION_PROFILE_SAMPLE_RATE - 1)
+#error "CEXCEPTION_PROFILE_SAMPLE_RATE must be a power of two"
+#endif
+
+typedef struct {
+	const void* site;       //return address of the Throw call, or faulting pc
+	const char* file;       //null unless thrown with CEXCEPTION_THROW_HERE
+	uint32_t line;
+	uint32_t samples;
+} CExceptionThrowSite;
+
+//where the calling thread's last exception was raised (samples is 0)
+void __cexception_get_last_throw_site(CExceptionThrowSite* site);
+
+#if CEXCEPTION_PROFILE_SITES
+//called by Throw and the fault handlers
+void __cexception_profile_throw(const void* site, const char* file, uint32_t line);
+
+//copy up to max sites, most samples first; returns the number copied
+unsigned int __cexception_hot_throw_sites(CExceptionThrowSite* sites, unsigned int max);
+
+//samples taken, and samples that did not fit in the table
+void __cexception_profile_totals(uint32_t* samples, uint32_t* untracked);
+
+//log the top max sites
+void __cexception_log_hot_throw_sites(unsigned int max);
+
+void __cexception_profile_reset();
+#endif
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_PROFILER_H
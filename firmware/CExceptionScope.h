@@ -0,0 +1,176 @@
+#ifndef _CEXCEPTION_SCOPE_H
+#define _CEXCEPTION_SCOPE_H
+
+#include "CException.h"
+
+//C++ layer under Try/Catch (header only).
+//
+//cexception::Scope is one Try level: enter() links it into the thread's frame before the setjmp, leave() unlinks
+//it on every way out. The Try, TryFor and Catch macros are thin wrappers around it, and so is attempt(), which
+//takes the protected block and the handler as function objects:
+//
+//    CEXCEPTION_T e = cexception::attempt([&]() { parse(buffer); }, [&](CEXCEPTION_T e) { reply(e); });
+//
+//Unlike Try, attempt() composes (it is an expression and returns the caught id, CEXCEPTION_NONE if there was
+//none), a return in the body only leaves the body, and locals the body changes need not be volatile: the body
+//reaches them through its captures, so they are in memory when Throw jumps. A cexception::Context holds the
+//calling thread's frame, so nested levels can share one lookup:
+//
+//    cexception::Context ctx;
+//    ctx.attempt([&]() { ctx.attempt(inner, innerHandler); step(); }, handler);
+//
+//The body and handler are inlined into attempt(); attempt() itself is one call, as no compiler inlines a
+//function that calls setjmp. Like CExceptionCleanupScope, a Context must not outlive a change of the calling
+//thread's registration.
+
+namespace cexception {
+
+class Scope {
+public:
+	explicit Scope(volatile CEXCEPTION_FRAME_T* frame) : frame(frame) { }
+
+	void enter() {
+		prev = frame->pFrame;
+		frame->pFrame = &jmp;
+		frame->Exception = CEXCEPTION_NONE;
+#if CEXCEPTION_ARENA_SIZE
+		arenaMark = frame->ArenaTop;
+#endif
+#if CEXCEPTION_STACK_USAGE
+		if(CEXCEPTION_TRACKS_DEPTH(frame))
+		{
+			depth = frame->TryDepth;
+			frame->TryDepth = depth + 1;
+			if(depth + 1 > frame->TryDepthMax)
+				frame->TryDepthMax = depth + 1;
+		}
+#endif
+		CEXCEPTION_METRICS_START_TRY(frame);
+	}
+
+	//end of the protected block, nothing thrown
+	void passed() {
+		frame->Exception = CEXCEPTION_NONE;
+	}
+
+	//setjmp returned through Throw: the id, CEXCEPTION_NONE for ExitTry
+	CEXCEPTION_T caught() {
+		CEXCEPTION_T e = frame->Exception;
+		CEXCEPTION_METRICS_START_CATCH(frame, e);
+		return e;
+	}
+
+	void leave() {
+		frame->pFrame = prev;
+#if CEXCEPTION_ARENA_SIZE
+		frame->ArenaTop = arenaMark;
+#endif
+#if CEXCEPTION_STACK_USAGE
+		//a Throw skips the leave() of the levels it crosses
+		if(CEXCEPTION_TRACKS_DEPTH(frame))
+			frame->TryDepth = depth;
+#endif
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+	CEXCEPTION_JMP_BUF jmp;
+
+protected:
+	volatile CEXCEPTION_FRAME_T* frame;
+	CEXCEPTION_JMP_BUF* prev;
+#if CEXCEPTION_ARENA_SIZE
+	uint32_t arenaMark;
+#endif
+#if CEXCEPTION_STACK_USAGE
+	uint16_t depth;
+#endif
+};
+
+//see TryFor
+class FilteredScope : public Scope {
+public:
+	FilteredScope(volatile CEXCEPTION_FRAME_T* frame, CExceptionMatch match) : Scope(frame) {
+		filter.match = match;
+	}
+
+	void enter() {
+		filter.next = frame->Filters;
+		filter.frame = &jmp;
+		filter.prev = frame->pFrame;
+		frame->Filters = &filter;
+		Scope::enter();
+	}
+
+	void leave() {
+		Scope::leave();
+		frame->Filters = filter.next;
+	}
+
+private:
+	CExceptionFilter filter;
+};
+
+//The same sequence as Try ... Catch(e) handler, hooks included; returns the caught id.
+template<typename S, typename Body, typename Handler>
+inline CEXCEPTION_T run(S& scope, volatile CEXCEPTION_FRAME_T* const MY_FRAME, Body& body, Handler& handler) {
+	(void)MY_FRAME;
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	scope.enter();
+	CEXCEPTION_HOOK_START_TRY;
+	if (CEXCEPTION_SETJMP(scope.jmp) == 0) {
+		body();
+		scope.passed();
+		CEXCEPTION_HOOK_HAPPY_TRY;
+	} else {
+		e = scope.caught();
+		CEXCEPTION_HOOK_START_CATCH;
+	}
+	scope.leave();
+	CEXCEPTION_HOOK_AFTER_TRY;
+	if (e != CEXCEPTION_NONE)
+		handler(e);
+	return e;
+}
+
+class Context {
+public:
+	Context() : frame(CEXCEPTION_GET_FRAME) { }
+	explicit Context(volatile CEXCEPTION_FRAME_T* frame) : frame(frame) { }
+
+	//run body; if it throws, run handler(id) once the exception has left the body
+	template<typename Body, typename Handler>
+	CEXCEPTION_T attempt(Body&& body, Handler&& handler) const {
+		Scope scope(frame);
+		return run(scope, frame, body, handler);
+	}
+
+	//the same, but ids outside filter go on to the next level out as with TryFor
+	template<typename Body, typename Handler>
+	CEXCEPTION_T attempt_for(CExceptionMatch filter, Body&& body, Handler&& handler) const {
+		FilteredScope scope(frame, filter);
+		return run(scope, frame, body, handler);
+	}
+
+	volatile CEXCEPTION_FRAME_T* get() const {
+		return frame;
+	}
+
+private:
+	volatile CEXCEPTION_FRAME_T* frame;
+};
+
+template<typename Body, typename Handler>
+inline CEXCEPTION_T attempt(Body&& body, Handler&& handler) {
+	return Context().attempt(body, handler);
+}
+
+template<typename Body, typename Handler>
+inline CEXCEPTION_T attempt_for(CExceptionMatch filter, Body&& body, Handler&& handler) {
+	return Context().attempt_for(filter, body, handler);
+}
+
+}
+
+#endif // _CEXCEPTION_SCOPE_H
@@ -0,0 +1,136 @@
+#include "CExceptionStacks.h"
+#include "application.h"
+#include <mutex>
+
+#if CEXCEPTION_MULTI_TASK && CEXCEPTION_STACK_ARENA
+
+static constexpr uint32_t stackClassSizes[] = { CEXCEPTION_STACK_CLASS_SIZES };
+static constexpr uint16_t stackClassCounts[] = { CEXCEPTION_STACK_CLASS_COUNTS };
+static constexpr unsigned int STACK_CLASSES = sizeof(stackClassSizes) / sizeof(stackClassSizes[0]);
+
+static constexpr size_t __cexception_stack_bytes(unsigned int i) {
+	return i == STACK_CLASSES ? 0 : (size_t)stackClassSizes[i] * stackClassCounts[i] + __cexception_stack_bytes(i + 1);
+}
+
+static constexpr unsigned int __cexception_stack_blocks(unsigned int i) {
+	return i == STACK_CLASSES ? 0 : stackClassCounts[i] + __cexception_stack_blocks(i + 1);
+}
+
+static constexpr bool __cexception_stack_classes_valid(unsigned int i) {
+	return i == STACK_CLASSES || (stackClassSizes[i] % CEXCEPTION_STACK_ALIGN == 0 &&
+			(i == 0 || stackClassSizes[i] > stackClassSizes[i - 1]) && __cexception_stack_classes_valid(i + 1));
+}
+
+static_assert(sizeof(stackClassCounts) / sizeof(stackClassCounts[0]) == STACK_CLASSES, "CEXCEPTION_STACK_CLASS_COUNTS needs one count per size");
+static_assert(__cexception_stack_classes_valid(0), "CEXCEPTION_STACK_CLASS_SIZES must ascend and be multiples of CEXCEPTION_STACK_ALIGN");
+
+enum : uint8_t {
+	STACK_FREE,
+	STACK_USED,         //owner is registered
+	STACK_RETIRED,      //owner unregistered, possibly still running on it
+};
+
+struct CExceptionStackBlock {
+	uint8_t* base;
+	void* owner;
+	uint8_t stackClass;
+	uint8_t state;
+};
+
+static uint8_t stackMemory[__cexception_stack_bytes(0)] __attribute__((aligned(CEXCEPTION_STACK_ALIGN)));
+static CExceptionStackBlock stackBlocks[__cexception_stack_blocks(0)];
+static CExceptionStackClassStats stackStats[STACK_CLASSES];
+static uint32_t stackFallbacks;
+static bool stackBlocksReady;
+static std::mutex stackLock;
+
+//blocks are laid out class by class, smallest first
+static void __cexception_stack_init() {
+	uint8_t* base = stackMemory;
+	unsigned int block = 0;
+	for(unsigned int c = 0; c < STACK_CLASSES; c++)
+	{
+		stackStats[c].size = stackClassSizes[c];
+		stackStats[c].count = stackClassCounts[c];
+		for(unsigned int i = 0; i < stackClassCounts[c]; i++, block++, base += stackClassSizes[c])
+		{
+			stackBlocks[block].base = base;
+			stackBlocks[block].stackClass = c;
+		}
+	}
+	stackBlocksReady = true;
+}
+
+static CExceptionStackBlock* __cexception_stack_find(void* stack) {
+	for(CExceptionStackBlock& block : stackBlocks)
+		if(block.base == stack)
+			return &block;
+	return nullptr;
+}
+
+extern "C" void* __cexception_stack_acquire(uint32_t size, uint32_t* blockSize) {
+	std::lock_guard<std::mutex> lck(stackLock);
+	if(!stackBlocksReady)
+		__cexception_stack_init();
+
+	for(CExceptionStackBlock& block : stackBlocks)
+	{
+		if(stackClassSizes[block.stackClass] < size)
+			continue;
+		if(block.state == STACK_RETIRED && os_thread_stack_released(block.owner, block.base))
+			block.state = STACK_FREE;
+		if(block.state != STACK_FREE)
+			continue;
+
+		CExceptionStackClassStats& stats = stackStats[block.stackClass];
+		block.state = STACK_USED;
+		block.owner = nullptr;
+		if(++stats.inUse > stats.highWater)
+			stats.highWater = stats.inUse;
+		*blockSize = stats.size;
+		return block.base;
+	}
+	stackFallbacks++;
+	return nullptr;
+}
+
+extern "C" void __cexception_stack_started(void* stack, void* threadHandle) {
+	std::lock_guard<std::mutex> lck(stackLock);
+	__cexception_stack_find(stack)->owner = threadHandle;
+}
+
+extern "C" void __cexception_stack_release(void* stack) {
+	std::lock_guard<std::mutex> lck(stackLock);
+	CExceptionStackBlock* block = __cexception_stack_find(stack);
+	block->state = STACK_FREE;
+	stackStats[block->stackClass].inUse--;
+}
+
+extern "C" void __cexception_stack_retire(void* threadHandle) {
+	std::lock_guard<std::mutex> lck(stackLock);
+	for(CExceptionStackBlock& block : stackBlocks)
+	{
+		if(block.state == STACK_USED && block.owner == threadHandle)
+		{
+			block.state = STACK_RETIRED;
+			stackStats[block.stackClass].inUse--;
+			return;
+		}
+	}
+}
+
+extern "C" unsigned int __cexception_stack_stats(CExceptionStackClassStats* stats, unsigned int max) {
+	std::lock_guard<std::mutex> lck(stackLock);
+	if(!stackBlocksReady)
+		__cexception_stack_init();
+	for(unsigned int c = 0; c < STACK_CLASSES && c < max; c++)
+		stats[c] = stackStats[c];
+	return STACK_CLASSES;
+}
+
+extern "C" uint32_t __cexception_stack_fallbacks() {
+	std::lock_guard<std::mutex> lck(stackLock);
+	return stackFallbacks;
+}
+
+#endif
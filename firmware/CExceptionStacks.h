@@ -0,0 +1,67 @@
+#ifndef _CEXCEPTION_STACKS_H
+#define _CEXCEPTION_STACKS_H
+
+#include "CException.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Stack arena for NEW_THREAD (CEXCEPTION_STACK_ARENA).
+//
+//Thread stacks come from one static block reserved at link time instead of the heap. The block is cut into
+//stack classes: CEXCEPTION_STACK_CLASS_COUNTS[i] stacks of CEXCEPTION_STACK_CLASS_SIZES[i] bytes, sizes in
+//ascending order. NEW_THREAD takes a free stack from the smallest class that fits the requested size (plus the
+//wrapper's 256 bytes) and falls back to a heap stack only when no class has one; such spawns are counted.
+//Unregistering the thread (KILL_THREAD, END_THREAD) hands its stack back. As the thread may still be running on
+//it at that point, the stack is reused only once the platform reports that the thread has left it.
+//
+//The platform provides two calls next to os_thread_create:
+//  os_thread_create_with_stack(thread, name, priority, fun, param, stack, stack_size)
+//      start a thread on caller-owned memory (xTaskCreateStatic on FreeRTOS, pthread_attr_setstack on the host)
+//  os_thread_stack_released(thread, stack)
+//      true once the thread started on stack has ended and will not touch it again; must not block
+
+#if CEXCEPTION_MULTI_TASK && CEXCEPTION_STACK_ARENA
+
+//stack sizes in bytes, ascending, each a multiple of CEXCEPTION_STACK_ALIGN
+#ifndef CEXCEPTION_STACK_CLASS_SIZES
+#define CEXCEPTION_STACK_CLASS_SIZES 1024, 2048, 4096
+#endif
+
+//stacks of each size
+#ifndef CEXCEPTION_STACK_CLASS_COUNTS
+#define CEXCEPTION_STACK_CLASS_COUNTS 4, 4, 2
+#endif
+
+#ifndef CEXCEPTION_STACK_ALIGN
+#define CEXCEPTION_STACK_ALIGN 16
+#endif
+
+typedef struct {
+	uint32_t size;
+	uint16_t count;
+	uint16_t inUse;         //taken by threads that have not been unregistered
+	uint16_t highWater;     //most ever in use at once
+} CExceptionStackClassStats;
+
+//fill up to max entries, smallest class first; returns the number of classes
+unsigned int __cexception_stack_stats(CExceptionStackClassStats* stats, unsigned int max);
+
+//NEW_THREAD calls that found no free stack and got one from the heap
+uint32_t __cexception_stack_fallbacks();
+
+//used by the thread registry
+void* __cexception_stack_acquire(uint32_t size, uint32_t* blockSize);
+void __cexception_stack_started(void* stack, void* threadHandle);
+void __cexception_stack_release(void* stack);
+void __cexception_stack_retire(void* threadHandle);
+
+#endif
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_STACKS_H
@@ -0,0 +1,90 @@
+#include "CException.h"
+#include "CExceptionTrace.h"
+#include "application.h"
+#include <string.h>
+#include <atomic>
+
+#if CEXCEPTION_TRACE_RECORDS
+
+//Writers claim a position with one atomic increment and own that record until they publish its sequence
+//number, which is cleared first and written last. A dump copies each record and keeps it only if its
+//sequence was published and did not change while it was being copied.
+
+static CExceptionTraceRecord CExceptionTraceRing[CEXCEPTION_TRACE_RECORDS];
+static std::atomic<uint32_t> CExceptionTraceWritten(0);
+
+extern "C" void __cexception_trace(CExceptionTraceType type, uint32_t exception, const void* site, const uint32_t* data, unsigned int dataWords) {
+	uint32_t pos = CExceptionTraceWritten.fetch_add(1, std::memory_order_relaxed);
+	CExceptionTraceRecord* r = &CExceptionTraceRing[pos & (CEXCEPTION_TRACE_RECORDS - 1)];
+	std::atomic<uint32_t>* sequence = (std::atomic<uint32_t>*)&r->sequence;
+
+	sequence->store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	r->version = CEXCEPTION_TRACE_VERSION;
+	r->type = (uint8_t)type;
+	r->slot = (uint16_t)CEXCEPTION_GET_ID;
+	r->exception = exception;
+	r->timestamp = (uint32_t)micros();
+	r->handle = (uint64_t)(uintptr_t)__cexception_get_current_thread_handle();
+	r->site = (uint64_t)(uintptr_t)site;
+	if(dataWords > CEXCEPTION_TRACE_DATA_WORDS)
+		dataWords = CEXCEPTION_TRACE_DATA_WORDS;
+	r->dataWords = data ? (uint8_t)dataWords : 0;
+	if(data)
+		memcpy(r->data, data, dataWords * sizeof(uint32_t));
+	sequence->store(pos + 1, std::memory_order_release);
+}
+
+extern "C" size_t __cexception_trace_dump(void* buffer, size_t size) {
+	size_t needed = sizeof(CExceptionTraceHeader) + sizeof(CExceptionTraceRing);
+	if(buffer == nullptr || size < needed)
+		return needed;
+
+	CExceptionTraceHeader* header = (CExceptionTraceHeader*)buffer;
+	CExceptionTraceRecord* out = (CExceptionTraceRecord*)(header + 1);
+	uint32_t written = CExceptionTraceWritten.load(std::memory_order_acquire);
+	uint32_t count = 0;
+
+	//oldest first
+	for(uint32_t i = 0; i < CEXCEPTION_TRACE_RECORDS; i++)
+	{
+		uint32_t pos = written + i;
+		CExceptionTraceRecord* r = &CExceptionTraceRing[pos & (CEXCEPTION_TRACE_RECORDS - 1)];
+		std::atomic<uint32_t>* sequence = (std::atomic<uint32_t>*)&r->sequence;
+		uint32_t before = sequence->load(std::memory_order_acquire);
+		if(before == 0)
+			continue;
+		memcpy(&out[count], r, sizeof(*r));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(sequence->load(std::memory_order_relaxed) != before)
+			continue;
+		count++;
+	}
+	memset(&out[count], 0, (CEXCEPTION_TRACE_RECORDS - count) * sizeof(CExceptionTraceRecord));
+
+	header->magic = CEXCEPTION_TRACE_MAGIC;
+	header->version = CEXCEPTION_TRACE_VERSION;
+	header->recordSize = sizeof(CExceptionTraceRecord);
+	header->recordCount = count;
+	header->written = written;
+	return sizeof(CExceptionTraceHeader) + count * sizeof(CExceptionTraceRecord);
+}
+
+#else
+
+extern "C" void __cexception_trace(CExceptionTraceType type, uint32_t exception, const void* site, const uint32_t* data, unsigned int dataWords) {
+}
+
+extern "C" size_t __cexception_trace_dump(void* buffer, size_t size) {
+	if(buffer == nullptr || size < sizeof(CExceptionTraceHeader))
+		return sizeof(CExceptionTraceHeader);
+	CExceptionTraceHeader* header = (CExceptionTraceHeader*)buffer;
+	header->magic = CEXCEPTION_TRACE_MAGIC;
+	header->version = CEXCEPTION_TRACE_VERSION;
+	header->recordSize = sizeof(CExceptionTraceRecord);
+	header->recordCount = 0;
+	header->written = 0;
+	return sizeof(CExceptionTraceHeader);
+}
+
+#endif
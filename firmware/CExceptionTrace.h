@@ -0,0 +1,85 @@
+#ifndef _CEXCEPTION_TRACE_H
+#define _CEXCEPTION_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Binary exception trace.
+//
+//Every Throw, hardware fault, thread death and unhandled exception is written as one fixed-size record into a
+//ring that keeps the most recent CEXCEPTION_TRACE_RECORDS events. Writing a record is a handful of stores and
+//one atomic increment, cheap enough to leave on in production. __cexception_trace_dump() copies the ring
+//into a self-describing blob (header + records) that can be written to flash or streamed out as is;
+//tools/trace_decode.cpp turns such a blob back into text or JSON on the host.
+//
+//The format is little-endian and identical on every target: pointers are stored as 64-bit words. Readers
+//must check the version and record size in the header and skip fields they do not understand.
+//
+//This header has no dependencies besides <stdint.h> so that tools can use it on their own.
+
+//ring capacity in records, a power of two; 0 compiles tracing out
+#ifndef CEXCEPTION_TRACE_RECORDS
+#define CEXCEPTION_TRACE_RECORDS 16
+#endif
+#if CEXCEPTION_TRACE_RECORDS & (CEXCEPTION_TRACE_RECORDS - 1)
+#error "CEXCEPTION_TRACE_RECORDS must be a power of two"
+#endif
+
+#define CEXCEPTION_TRACE_MAGIC 0x54584543u      //"CEXT"
+#define CEXCEPTION_TRACE_VERSION 1
+#define CEXCEPTION_TRACE_DATA_WORDS 10
+
+typedef enum {
+	CEXCEPTION_TRACE_THROW = 1,         //Throw(), site is the caller
+	CEXCEPTION_TRACE_FAULT = 2,         //hardware fault, site is the faulting pc, data holds the fault record
+	CEXCEPTION_TRACE_THREAD_DIED = 3,   //exception left a NEW_THREAD thread
+	CEXCEPTION_TRACE_UNHANDLED = 4,     //Throw outside any Try, handed to CException_Global_Handler
+} CExceptionTraceType;
+
+typedef struct {
+	uint32_t magic;                     //CEXCEPTION_TRACE_MAGIC
+	uint16_t version;                   //CEXCEPTION_TRACE_VERSION
+	uint16_t recordSize;                //sizeof(CExceptionTraceRecord)
+	uint32_t recordCount;               //records that follow
+	uint32_t written;                   //records written since boot, including overwritten ones
+} CExceptionTraceHeader;
+
+typedef struct {
+	uint32_t sequence;                  //1-based position in the trace, 0 for an empty or torn record
+	uint8_t version;                    //CEXCEPTION_TRACE_VERSION
+	uint8_t type;                       //CExceptionTraceType
+	uint8_t dataWords;                  //valid words in data
+	uint8_t reserved0;
+	uint16_t slot;                      //registry slot of the thread, 0 if not registered
+	uint16_t reserved1;
+	uint32_t exception;                 //exception id
+	uint32_t timestamp;                 //micros()
+	uint32_t reserved2;
+	uint64_t handle;                    //thread handle
+	uint64_t site;                      //throw-site return address or faulting pc
+	uint32_t data[CEXCEPTION_TRACE_DATA_WORDS];
+} CExceptionTraceRecord;
+
+#ifdef __cplusplus
+static_assert(sizeof(CExceptionTraceHeader) == 16, "trace header layout changed");
+static_assert(sizeof(CExceptionTraceRecord) == 80, "trace record layout changed");
+#endif
+
+//append a record for the calling thread; data may be null, extra words beyond CEXCEPTION_TRACE_DATA_WORDS are
+//not recorded
+void __cexception_trace(CExceptionTraceType type, uint32_t exception, const void* site, const uint32_t* data, unsigned int dataWords);
+
+//copy the trace (header + records, oldest first) to buffer and return the bytes used. If buffer is null or
+//smaller than a full trace, nothing is copied and the size of a full trace is returned.
+size_t __cexception_trace_dump(void* buffer, size_t size);
+
+#ifdef __cplusplus
+}   // extern "C"
+#endif
+
+#endif // _CEXCEPTION_TRACE_H
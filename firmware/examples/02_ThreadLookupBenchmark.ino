@@ -0,0 +1,47 @@
+#include "application.h"
+#include <CException/CException.h>
+
+SerialLogHandler logger(LOG_LEVEL_INFO);
+
+//Measures the cost of CEXCEPTION_GET_ID (run by every Try, Throw and Catch) as the registry grows.
+//The registry is filled with placeholder handles; only the calling thread's slot is real, and it is
+//registered last so a linear scan would have to walk the whole table to find it.
+
+static const unsigned int LOOKUPS = 10000;
+static const unsigned int MAX_THREADS = 256;
+
+static uint32_t fakeHandles[MAX_THREADS];
+
+static void benchmarkThread(void* arg) {
+	void* self = __cexception_get_current_thread_handle();
+	unsigned int registered = 1;
+	for(unsigned int count = 2; count <= MAX_THREADS; count *= 2)
+	{
+		CEXCEPTION_SET_NUM_THREADS(count + 1);
+
+		//re-register ourselves after the placeholders so we end up in the last slot
+		__cexception_unregister_current_thread();
+		for(; registered < count; registered++)
+			__cexception_register_thread(&fakeHandles[registered], "fake", nullptr);
+		__cexception_register_thread(self, "bench", nullptr);
+
+		volatile unsigned int sink = 0;
+		uint32_t start = System.ticks();
+		for(unsigned int i = 0; i < LOOKUPS; i++)
+			sink += CEXCEPTION_GET_ID;
+		uint32_t ticks = System.ticks() - start;
+
+		LOG(INFO, "%3u threads: %lu ns/lookup (slot %u)", count,
+				(unsigned long)(ticks * 1000ULL / System.ticksPerMicrosecond() / LOOKUPS), CEXCEPTION_GET_ID);
+	}
+	END_THREAD();
+}
+
+void setup() {
+	delay(2000);
+	CEXCEPTION_SET_NUM_THREADS(2);
+	NEW_THREAD(nullptr, "Lookup Bench", OS_THREAD_PRIORITY_DEFAULT, benchmarkThread, nullptr, 2048, nullptr);
+}
+
+void loop() {
+}
@@ -0,0 +1,68 @@
+#ifndef _CEXCEPTION_HOST_APPLICATION_H
+#define _CEXCEPTION_HOST_APPLICATION_H
+
+//Host (Linux/pthreads) stand-in for the subset of the Particle firmware API used by CException,
+//its examples and its tests. Only what the library touches is provided; semantics follow the device
+//HAL closely enough that the registry, thread wrapper and Try/Catch/Throw behave the same.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+#include "logging.h"
+
+#ifndef CEXCEPTION_PLATFORM_HOST
+#define CEXCEPTION_PLATFORM_HOST 1
+#endif
+
+//concurrency_hal.h
+typedef void* os_thread_t;
+typedef uint8_t os_thread_prio_t;
+typedef int os_result_t;
+typedef void (*os_thread_fn_t)(void* param);
+
+#define OS_THREAD_PRIORITY_DEFAULT      (2)
+#define OS_THREAD_PRIORITY_CRITICAL     (9)
+#define OS_THREAD_STACK_SIZE_DEFAULT    (3*1024)
+
+//pthreads needs considerably more stack than FreeRTOS for the same code (libc formatting, signal frames),
+//so requested sizes are raised to at least this much.
+#define OS_THREAD_STACK_SIZE_HOST_MIN   (64*1024)
+
+os_result_t os_thread_create(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun, void* thread_param, size_t stack_size);
+bool os_thread_is_current(os_thread_t thread);
+os_result_t os_thread_cleanup(os_thread_t thread);
+os_result_t os_thread_yield();
+
+//start a thread on caller-owned stack memory, for CEXCEPTION_STACK_ARENA (stack_size is used as given)
+os_result_t os_thread_create_with_stack(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun, void* thread_param, void* stack, size_t stack_size);
+//whether the thread started on stack has ended and left it; never blocks
+bool os_thread_stack_released(os_thread_t thread, void* stack);
+
+//lowest address and size of the calling thread's stack, for CEXCEPTION_STACK_USAGE
+bool os_thread_current_stack(void** low, size_t* size);
+
+//host only: handle of the calling thread (the device resolves this through xTaskGetCurrentTaskHandle)
+os_thread_t os_thread_current();
+//host only: name given to os_thread_create ("main" for the process thread)
+const char* os_thread_name(os_thread_t thread);
+
+//delay_hal.h / timer_hal.h
+void delay(unsigned long ms);
+void HAL_Delay_Microseconds(uint32_t us);
+uint32_t millis();
+uint32_t micros();
+
+//panic.h
+typedef enum {
+	HardFault = 1,
+} ePanicCode;
+void panic_(ePanicCode code, void* extraInfo, void (*HAL_Delay_Microseconds)(uint32_t));
+
+//The device suspends the scheduler; the host has nothing equivalent and the only user is the
+//unhandled-exception path, which just logs and halts.
+#define SINGLE_THREADED_SECTION()
+
+#endif // _CEXCEPTION_HOST_APPLICATION_H
@@ -0,0 +1,195 @@
+#include "application.h"
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unordered_map>
+
+//Thread handles are pointers to this record, mirroring the device where os_thread_t is the FreeRTOS TCB.
+struct os_thread_host {
+	pthread_t thread;
+	os_thread_fn_t fun;
+	void* param;
+	char name[16];
+};
+
+static thread_local os_thread_host* currentThread = nullptr;
+
+static void* thread_trampoline(void* arg) {
+	os_thread_host* th = (os_thread_host*)arg;
+	currentThread = th;
+	th->fun(th->param);
+	//FreeRTOS tasks must never return; the thread wrapper always ends with END_THREAD, so this only
+	//catches raw os_thread_create users
+	os_thread_cleanup(nullptr);
+	return nullptr;
+}
+
+static os_result_t os_thread_start(os_thread_t* thread, const char* name, os_thread_fn_t fun, void* thread_param, pthread_attr_t* attr) {
+	os_thread_host* th = (os_thread_host*)calloc(1, sizeof(os_thread_host));
+	if(!th) {
+		*thread = nullptr;
+		return ENOMEM;
+	}
+	th->fun = fun;
+	th->param = thread_param;
+	strncpy(th->name, name ? name : "", sizeof(th->name) - 1);
+
+	//publish the handle before the thread can run, as the device does
+	*thread = th;
+	int result = pthread_create(&th->thread, attr, thread_trampoline, th);
+	if(result != 0) {
+		free(th);
+		*thread = nullptr;
+		return result;
+	}
+	pthread_setname_np(th->thread, th->name);
+	return 0;
+}
+
+os_result_t os_thread_create(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun, void* thread_param, size_t stack_size) {
+	(void)priority; //scheduling policy changes need privileges; all host threads share one priority
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, stack_size < OS_THREAD_STACK_SIZE_HOST_MIN ? OS_THREAD_STACK_SIZE_HOST_MIN : stack_size);
+	os_result_t result = os_thread_start(thread, name, fun, thread_param, &attr);
+	pthread_attr_destroy(&attr);
+	return result;
+}
+
+//Threads on caller-owned stacks stay joinable: a thread is off its stack only once it can be joined, which is
+//after the handle record has been freed, so they are remembered by stack.
+static std::mutex stackThreadsLock;
+static std::unordered_map<void*, pthread_t> stackThreads;
+
+os_result_t os_thread_create_with_stack(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun, void* thread_param, void* stack, size_t stack_size) {
+	(void)priority;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	int result = pthread_attr_setstack(&attr, stack, stack_size);
+	if(result == 0) {
+		std::lock_guard<std::mutex> lck(stackThreadsLock);
+		result = os_thread_start(thread, name, fun, thread_param, &attr);
+		if(result == 0)
+			stackThreads[stack] = ((os_thread_host*)*thread)->thread;
+	} else
+		*thread = nullptr;
+	pthread_attr_destroy(&attr);
+	return result;
+}
+
+bool os_thread_stack_released(os_thread_t thread, void* stack) {
+	(void)thread;
+	std::lock_guard<std::mutex> lck(stackThreadsLock);
+	auto it = stackThreads.find(stack);
+	if(it == stackThreads.end())
+		return true;
+	if(pthread_tryjoin_np(it->second, nullptr) != 0)
+		return false;
+	stackThreads.erase(it);
+	return true;
+}
+
+os_thread_t os_thread_current() {
+	if(currentThread == nullptr) {
+		//a thread not started through os_thread_create (e.g. main); give it a handle on first use
+		//the record is intentionally never freed, handles must stay unique while the process runs
+		os_thread_host* th = (os_thread_host*)calloc(1, sizeof(os_thread_host));
+		th->thread = pthread_self();
+		if(pthread_getname_np(th->thread, th->name, sizeof(th->name)) != 0)
+			strcpy(th->name, "main");
+		currentThread = th;
+	}
+	return currentThread;
+}
+
+bool os_thread_current_stack(void** low, size_t* size) {
+	pthread_attr_t attr;
+	if(pthread_getattr_np(pthread_self(), &attr) != 0)
+		return false;
+	int result = pthread_attr_getstack(&attr, low, size);
+	pthread_attr_destroy(&attr);
+	return result == 0;
+}
+
+bool os_thread_is_current(os_thread_t thread) {
+	return thread != nullptr && thread == currentThread;
+}
+
+const char* os_thread_name(os_thread_t thread) {
+	return thread ? ((os_thread_host*)thread)->name : "NO NAME";
+}
+
+os_result_t os_thread_cleanup(os_thread_t thread) {
+	if(thread == nullptr || thread == currentThread) {
+		os_thread_host* th = currentThread;
+		currentThread = nullptr;
+		free(th);
+		pthread_exit(nullptr);
+	}
+	return pthread_cancel(((os_thread_host*)thread)->thread);
+}
+
+os_result_t os_thread_yield() {
+	return sched_yield();
+}
+
+static uint64_t monotonic_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t startup_us = monotonic_us();
+
+uint32_t millis() {
+	return (uint32_t)((monotonic_us() - startup_us) / 1000);
+}
+
+uint32_t micros() {
+	return (uint32_t)(monotonic_us() - startup_us);
+}
+
+void HAL_Delay_Microseconds(uint32_t us) {
+	struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+	while(nanosleep(&ts, &ts) != 0 && errno == EINTR) { }
+}
+
+void delay(unsigned long ms) {
+	HAL_Delay_Microseconds(ms * 1000);
+}
+
+void panic_(ePanicCode code, void* extraInfo, void (*delayFn)(uint32_t)) {
+	(void)extraInfo;
+	(void)delayFn;
+	fprintf(stderr, "PANIC %d\n", (int)code);
+	abort();
+}
+
+static volatile LogLevel logThreshold = LOG_LEVEL_INFO;
+
+SerialLogHandler::SerialLogHandler(LogLevel level) {
+	logThreshold = level;
+}
+
+static const char* level_name(LogLevel level) {
+	if(level >= LOG_LEVEL_PANIC) return "PANIC";
+	if(level >= LOG_LEVEL_ERROR) return "ERROR";
+	if(level >= LOG_LEVEL_WARN) return "WARN";
+	if(level >= LOG_LEVEL_INFO) return "INFO";
+	return "TRACE";
+}
+
+void __cexception_host_log(LogLevel level, const char* fmt, ...) {
+	if(level < logThreshold)
+		return;
+	char line[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	fprintf(stderr, "%010u [%s] %s\n", (unsigned)millis(), level_name(level), line);
+}
@@ -0,0 +1,31 @@
+#ifndef _CEXCEPTION_HOST_LOGGING_H
+#define _CEXCEPTION_HOST_LOGGING_H
+
+//Host stand-in for the Particle logging macros. Messages go to stderr, filtered by the level of the
+//most recently constructed SerialLogHandler (INFO until one exists). LOG_DEBUG is compiled out,
+//as it is in non-debug device builds.
+
+#include <stdarg.h>
+
+typedef enum {
+	LOG_LEVEL_ALL = 1,
+	LOG_LEVEL_TRACE = 1,
+	LOG_LEVEL_INFO = 30,
+	LOG_LEVEL_WARN = 40,
+	LOG_LEVEL_ERROR = 50,
+	LOG_LEVEL_PANIC = 60,
+	LOG_LEVEL_NONE = 70
+} LogLevel;
+
+void __cexception_host_log(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+class SerialLogHandler {
+public:
+	explicit SerialLogHandler(LogLevel level = LOG_LEVEL_INFO);
+};
+
+#define LOG_SOURCE_CATEGORY(name)
+#define LOG(level, fmt, ...) __cexception_host_log(LOG_LEVEL_##level, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(level, fmt, ...) do { } while(0)
+
+#endif // _CEXCEPTION_HOST_LOGGING_H
@@ -0,0 +1,47 @@
+#include "unit-test/unit-test.h"
+#include <string.h>
+#include <stdlib.h>
+
+static Test* tests[256];
+static int testCount = 0;
+
+Test* Test::current = nullptr;
+
+Test::Test(const char* name, void (*body)()) : name(name), body(body), state(PENDING) {
+	if(testCount < (int)(sizeof(tests) / sizeof(tests[0])))
+		tests[testCount++] = this;
+}
+
+void Test::report_failure(const char* file, int line, const char* what) {
+	fprintf(stderr, "%s:%d: %s failed in %s\n", file, line, what, current ? current->name : "?");
+	if(current)
+		current->state = FAILED;
+}
+
+bool Test::passed(const char* name) {
+	for(int i = 0; i < testCount; i++)
+		if(strcmp(tests[i]->name, name) == 0)
+			return tests[i]->state == PASSED;
+	return false;
+}
+
+static int compare_tests(const void* a, const void* b) {
+	return strcmp((*(Test* const*)a)->name, (*(Test* const*)b)->name);
+}
+
+int Test::run() {
+	qsort(tests, testCount, sizeof(tests[0]), compare_tests);
+	int failed = 0;
+	for(int i = 0; i < testCount; i++) {
+		current = tests[i];
+		current->body();
+		if(current->state != FAILED)
+			current->state = PASSED;
+		else
+			failed++;
+		printf("Test %s %s.\n", current->name, current->state == PASSED ? "passed" : "failed");
+	}
+	current = nullptr;
+	printf("Test summary: %d passed, %d failed, and 0 skipped, out of %d test(s).\n", testCount - failed, failed, testCount);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+#ifndef _CEXCEPTION_HOST_UNIT_TEST_H
+#define _CEXCEPTION_HOST_UNIT_TEST_H
+
+//Host stand-in for Particle's unit-test (ArduinoUnit) macros, enough to run tests/*.cpp on Linux.
+//Tests run in name order, like on the device, so GroupN prefixes still control ordering.
+//A failed assert marks the test failed and returns from it, as ArduinoUnit does.
+
+#include <stdio.h>
+
+class Test {
+public:
+	enum State { PENDING, PASSED, FAILED };
+
+	Test(const char* name, void (*body)());
+
+	const char* name;
+	void (*body)();
+	State state;
+
+	static Test* current;
+	static int run();
+	static void report_failure(const char* file, int line, const char* what);
+	static bool passed(const char* name);
+};
+
+template<typename A, typename B>
+static inline bool __unit_test_equal(const A& a, const B& b) { return a == b; }
+
+#define test(name)                                                  \
+	static void name##_body();                                      \
+	static Test name##_instance(#name, name##_body);                \
+	static void name##_body()
+
+#define __UNIT_TEST_ASSERT(cond, text)                              \
+	do { if(!(cond)) { Test::report_failure(__FILE__, __LINE__, text); return; } } while(0)
+
+#define fail() Test::report_failure(__FILE__, __LINE__, "fail()")
+#define assertTrue(x) __UNIT_TEST_ASSERT((x), "assertTrue(" #x ")")
+#define assertFalse(x) __UNIT_TEST_ASSERT(!(x), "assertFalse(" #x ")")
+#define assertEqual(x, y) __UNIT_TEST_ASSERT(__unit_test_equal((x), (y)), "assertEqual(" #x ", " #y ")")
+#define assertNotEqual(x, y) __UNIT_TEST_ASSERT(!__unit_test_equal((x), (y)), "assertNotEqual(" #x ", " #y ")")
+#define assertTestPass(name) __UNIT_TEST_ASSERT(Test::passed(#name), "assertTestPass(" #name ")")
+
+#define UNIT_TEST_APP() int main() { return Test::run(); }
+
+#endif // _CEXCEPTION_HOST_UNIT_TEST_H
@@ -1,6 +1,15 @@
 #include "application.h"
 #include "CException/CException.h"
+#include "CException/CExceptionEvents.h"
+#include "CException/CExceptionTrace.h"
+#include "CException/CExceptionPool.h"
+#include "CException/CExceptionParallel.h"
+#include "CException/CExceptionStacks.h"
 #include "unit-test/unit-test.h"
+#include <atomic>
+#ifdef CEXCEPTION_PLATFORM_HOST
+#include <signal.h>
+#endif
 
 static void callInvalidFunction() {
 	((void(*)())(0xdeadbeef))();
@@ -22,7 +31,7 @@ static void setUp(void)
 	threadStage1 = false;
 	threadStage2 = false;
 	threadException = 0;
-    CExceptionFrames[0].pFrame = NULL; //TODO: need to initialize all frames
+    __cexception_get_frame(0)->pFrame = NULL; //TODO: need to initialize all frames
     TestingTheFallback = 0;
     TestingTheFallbackId = 0;
     __cexception_hangOnUnHandledGlobalException = false;
@@ -33,6 +42,31 @@ static void tearDown(void)
 	__cexception_hangOnUnHandledGlobalException = true;
 }
 
+//Stands in for a thread handle in registry tests. The registry looks up thread names through the handle, so
+//it is zeroed, aligned and as large as a host thread object, like the real thing.
+struct alignas(16) FakeThread {
+	uint8_t bytes[64];
+};
+
+//Make room for `extra` more registered threads; returns the active count to wait for with waitForThreads.
+static unsigned int reserveThreads(unsigned int extra)
+{
+	unsigned int before = __cexception_get_active_thread_count();
+	if(__cexception_get_number_of_threads() < before + extra)
+		CEXCEPTION_SET_NUM_THREADS(before + extra);
+	return before;
+}
+
+//Poll until no more than `count` threads are registered; false if that takes longer than timeoutMs. There is
+//no signal for a thread having unregistered, so a test using this depends on its threads ending in time.
+static bool waitForThreads(unsigned int count, unsigned int timeoutMs = 1000)
+{
+	for(unsigned int waited = 0; waited < timeoutMs && __cexception_get_active_thread_count() > count; waited++)
+		delay(1);
+	return __cexception_get_active_thread_count() <= count;
+}
+
+#ifndef CEXCEPTION_PLATFORM_HOST
 test(CException_Group2_CatchAHardwareException) {
 	setUp();
 
@@ -63,6 +97,72 @@ test(CException_Group2_CatchAHardwareException) {
 
 	tearDown();
 }
+#else
+test(CException_Group2_CatchAHardwareException) {
+	setUp();
+
+	assertTestPass(CException_Group1_SetNumberOfThreads);
+	assertTestPass(CException_Group1_Activate_Hardware_Handlers);
+
+	CEXCEPTION_T e;
+	bool caught = false;
+	Try {
+		callInvalidFunction();
+	} Catch(e) {
+		caught = true;
+	}
+
+	//verify an exception was caught
+	assertTrue(caught);
+
+	//verify a hardware exception code
+	assertEqual(EXCEPTION_HARDWARE, e);
+
+	//verify the faulting pc (host layout: [6] = pc, [7] = signal)
+	assertEqual(CEXCEPTION_CURRENT_DATA[6], 0xdeadbeef);
+	assertEqual(CEXCEPTION_CURRENT_DATA[7], (uint32_t)SIGSEGV);
+
+	tearDown();
+}
+
+#if CEXCEPTION_FAULT_EXTENDED
+test(CException_Group2_HardwareFaultRecordsSp) {
+	setUp();
+
+	assertTestPass(CException_Group1_Activate_Hardware_Handlers);
+
+	volatile int local = 0;
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	Try {
+		callInvalidFunction();
+	} Catch(e) {
+	}
+
+	assertEqual(EXCEPTION_HARDWARE, e);
+	const CExceptionFaultRecord* fault = CEXCEPTION_CURRENT_FAULT;
+	assertEqual(fault->pc, 0xdeadbeef);
+	//the faulting sp is a little below this frame
+	uint32_t distance = (uint32_t)(uintptr_t)&local - fault->sp;
+	assertTrue(distance < 4096);
+
+	tearDown();
+}
+#endif
+
+test(CException_Group1_Activate_Hardware_Handlers) {
+	setUp();
+
+	CEXCEPTION_ACTIVATE_HW_HANDLERS();
+
+	struct sigaction sa;
+	sigaction(SIGSEGV, nullptr, &sa);
+
+	//verify the segfault handler is installed
+	assertTrue(sa.sa_flags & SA_SIGINFO);
+
+	tearDown();
+}
+#endif
 
 test(CException_Group1_SetNumberOfThreads) {
 	setUp();
@@ -131,7 +231,7 @@ test(CException_Group2_ThreadWithHandlePtr) {
 	}
 
 	//verify thread
-	assertNotEqual((uint32_t)thread, (uint32_t)nullptr);
+	assertNotEqual((uintptr_t)thread, (uintptr_t)nullptr);
 
 	//wait for thread to end
 	delay(30);
@@ -195,7 +295,7 @@ test(CException_Group2_ThrowThreadAndCallback) {
 	}
 
 	//verify we got a thread
-	assertNotEqual((uint32_t)thread, (uint32_t)nullptr);
+	assertNotEqual((uintptr_t)thread, (uintptr_t)nullptr);
 
 	//wait for thread to start
 	delay(10);
@@ -218,6 +318,7 @@ test(CException_Group2_ThrowThreadAndCallback) {
 	tearDown();
 }
 
+#ifndef CEXCEPTION_PLATFORM_HOST
 static void throwHardwareExceptionThread(void* arg) {
 	threadRan = true;
 	delay(20);
@@ -245,7 +346,7 @@ test(CException_Group2_HWExceptionThread) {
 	}
 
 	//check to make sure we got a thread
-	assertNotEqual((uint32_t)thread, (uint32_t)nullptr);
+	assertNotEqual((uintptr_t)thread, (uintptr_t)nullptr);
 
 	//wait for thread to start
 	delay(10);
@@ -270,6 +371,7 @@ test(CException_Group2_HWExceptionThread) {
 
 	tearDown();
 }
+#endif
 
 test(CException_Group2_TooManyThreadsAndThreadCount) {
 	setUp();
@@ -435,6 +537,111 @@ test(CException_Group2_BEGIN_LOCK_SAFE_NoThrow) {
 
 }
 
+static std::mutex lockSafeMutexes[3];
+
+static __attribute__((noinline)) void lockAndThrow(unsigned int depth) {
+	if(depth == 3)
+		Throw(0xbd);
+	BEGIN_LOCK_SAFE(lockSafeMutexes[depth])
+	{
+		lockAndThrow(depth + 1);
+	} END_LOCK_SAFE();
+}
+
+static bool lockSafeReturn(std::mutex& mutex) {
+	BEGIN_LOCK_SAFE(mutex)
+	{
+		return true;
+	} END_LOCK_SAFE();
+	return false;
+}
+
+test(CException_Group2_BEGIN_LOCK_SAFE_Nested) {
+	std::mutex outer;
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	bool outerHeldInCatch = false;
+	BEGIN_LOCK_SAFE(outer)
+	{
+		Try {
+			lockAndThrow(0);
+		} Catch(e) {
+			outerHeldInCatch = !outer.try_lock();
+		}
+	} END_LOCK_SAFE();
+
+	assertEqual(e, 0xbd);
+	//one throw released all three sections inside the Try, but not the one around it
+	assertTrue(outerHeldInCatch);
+	for(std::mutex& mutex : lockSafeMutexes) {
+		assertTrue(mutex.try_lock());
+		mutex.unlock();
+	}
+	assertTrue(outer.try_lock());
+	outer.unlock();
+	assertTrue(CEXCEPTION_GET_FRAME->Cleanups == nullptr);
+
+	//leaving a section with return unlocks it as well
+	assertTrue(lockSafeReturn(outer));
+	assertTrue(outer.try_lock());
+	outer.unlock();
+	assertTrue(CEXCEPTION_GET_FRAME->Cleanups == nullptr);
+}
+
+//records the cleanup stack as it is when the lock is released
+struct RecordingLock {
+	CExceptionCleanup* cleanupsAtUnlock;
+	void lock() { }
+	void unlock() { cleanupsAtUnlock = CEXCEPTION_GET_FRAME->Cleanups; }
+};
+
+test(CException_Group2_BEGIN_LOCK_SAFE_PopsBeforeUnlock) {
+	RecordingLock lock;
+	lock.cleanupsAtUnlock = (CExceptionCleanup*)&lock;
+	BEGIN_LOCK_SAFE(lock)
+	{
+	} END_LOCK_SAFE();
+
+	//a throw from here on must not find the section's entry and unlock a second time
+	assertTrue(lock.cleanupsAtUnlock == nullptr);
+}
+
+static char cleanupOrder[8];
+static unsigned int cleanupCount;
+
+static __attribute__((noinline)) void cleanupAndThrow(unsigned int depth, bool doThrow) {
+	if(depth == 3) {
+		if(doThrow)
+			Throw(0xc1);
+		return;
+	}
+	BEGIN_CLEANUP([depth]() { cleanupOrder[cleanupCount++] = (char)('0' + depth); })
+	{
+		cleanupAndThrow(depth + 1, doThrow);
+	} END_CLEANUP();
+}
+
+test(CException_Group2_BEGIN_CLEANUP_RunsOnlyOnThrow) {
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	cleanupCount = 0;
+	Try {
+		cleanupAndThrow(0, false);
+	} Catch(e) {
+	}
+	assertEqual(e, CEXCEPTION_NONE);
+	assertEqual(cleanupCount, 0);
+
+	Try {
+		cleanupAndThrow(0, true);
+	} Catch(e) {
+	}
+	assertEqual(e, 0xc1);
+	//innermost first
+	assertEqual(cleanupCount, 3);
+	assertTrue(memcmp(cleanupOrder, "210", 3) == 0);
+	assertTrue(CEXCEPTION_GET_FRAME->Cleanups == nullptr);
+}
+
+#ifndef CEXCEPTION_PLATFORM_HOST
 #include "core_cm3.h"
 
 test(CException_Group1_Activate_Hardware_Handlers) {
@@ -546,17 +753,20 @@ test(CException_Group1_GetBLTargetFromFunctionPointer)
 	assertEqual((uint32_t)callInvalidFunction, (uint32_t)c1);
 	assertEqual((uint32_t)os_mutex_destroy, (uint32_t)c2);
 }
+#endif
 
 static void throwMyHandleThread(void* arg) {
 	delay(20);
-	Throw((uint32_t)__cexception_get_current_thread_handle());
+	Throw((uint32_t)(uintptr_t)__cexception_get_current_thread_handle());
 }
 
 test(CException_Group2_GetThreadHandle)
 {
 	setUp();
 
+#ifndef CEXCEPTION_PLATFORM_HOST
 	assertTestPass(CException_Group1_GetBLTargetFromFunctionPointer);
+#endif
 	assertTestPass(CException_Group1_SetNumberOfThreads);
 
 	bool caught = false;
@@ -569,9 +779,9 @@ test(CException_Group2_GetThreadHandle)
 	}
 
 	assertFalse(caught);
-	assertNotEqual((uint32_t)handle, 0);
+	assertNotEqual((uintptr_t)handle, 0);
 	delay(25);
-	assertEqual((uint32_t)handle, (uint32_t)threadException);
+	assertEqual((uint32_t)(uintptr_t)handle, (uint32_t)threadException);
 
 	tearDown();
 }
@@ -603,7 +813,7 @@ test(CException_Group3_GetThreadName)
 	}
 
 	assertFalse(caught);
-	assertNotEqual((uint32_t)handle, 0);
+	assertNotEqual((uintptr_t)handle, 0);
 	delay(20);
 	assertTrue(strcmp("Test Thread", nameCopy) == 0);
 
@@ -611,3 +821,1029 @@ test(CException_Group3_GetThreadName)
 }
 
 
+
+static volatile bool stressStop;
+static volatile int stressErrors;
+static volatile int stressIterations;
+static std::atomic<unsigned int> stressReady(0);
+static std::atomic<bool> stressGo(false);
+static std::atomic<unsigned int> growGeneration(0);
+static std::atomic<unsigned int> growsMidThrow(0);
+
+//wait at the start barrier: the caller's `ready` counts arrivals, `go` opens it
+static void startBarrier(std::atomic<unsigned int>& ready, std::atomic<bool>& go) {
+	ready.fetch_add(1);
+	while(!go.load())
+		os_thread_yield();
+}
+
+static void throwLoopThread(void* arg) {
+	startBarrier(stressReady, stressGo);
+	while(!stressStop) {
+		CEXCEPTION_T e = 0;
+		unsigned int generation = growGeneration.load();
+		Try {
+			Throw(0x51);
+		} Catch(e) {
+		}
+		//the table was replaced between this thread's Try and its Catch
+		if(growGeneration.load() != generation)
+			growsMidThrow.fetch_add(1);
+		if(e != 0x51)
+			stressErrors++;
+		stressIterations++;
+	}
+}
+
+test(CException_Group3_GrowTableWhileThrowing)
+{
+	setUp();
+
+	assertTestPass(CException_Group1_SetNumberOfThreads);
+
+	stressStop = false;
+	stressErrors = 0;
+	stressIterations = 0;
+	stressReady = 0;
+	stressGo = false;
+	growsMidThrow = 0;
+
+	bool caught = false;
+	CEXCEPTION_T e;
+	Try {
+		NEW_THREAD(nullptr, "Stress1", OS_THREAD_PRIORITY_DEFAULT, throwLoopThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, exceptionCallback);
+		NEW_THREAD(nullptr, "Stress2", OS_THREAD_PRIORITY_DEFAULT, throwLoopThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, exceptionCallback);
+		while(stressReady.load() < 2)
+			os_thread_yield();
+		stressGo = true;
+
+		//grow the registry while the other threads are inside Try/Throw, a few more times if none of the
+		//growths has landed between a Try and its Catch yet
+		for(int i = 0; i < 20 && (i < 10 || growsMidThrow.load() == 0); i++) {
+			CEXCEPTION_SET_NUM_THREADS(__cexception_get_number_of_threads() + 4);
+			growGeneration.fetch_add(1);
+			os_thread_yield();
+		}
+	} Catch(e) {
+		caught = true;
+	}
+	stressStop = true;
+
+	assertFalse(caught);
+	assertTrue(waitForThreads(0));
+	assertTrue(growsMidThrow.load() >= 1);
+	assertTrue(stressIterations > 0);
+	assertEqual((int)stressErrors, 0);
+
+	tearDown();
+}
+
+test(CException_Group3_RegisterGrowsTable)
+{
+	setUp();
+
+	static FakeThread handles[128];
+	unsigned int before = __cexception_get_number_of_threads();
+	assertTrue(before < sizeof(handles) / sizeof(handles[0]));
+
+	//register one more thread than there are free slots
+	bool caught = false;
+	CEXCEPTION_T e;
+	Try {
+		for(unsigned int i = 0; i < before; i++)
+			__cexception_register_thread(&handles[i], "Fake", nullptr);
+	} Catch(e) {
+		caught = true;
+	}
+
+	//verify the table grew instead of throwing EXCEPTION_OUT_OF_MEM
+	assertFalse(caught);
+	assertTrue(__cexception_get_number_of_threads() > before);
+	assertEqual(__cexception_get_active_thread_count(), before);
+
+	for(unsigned int i = 0; i < before; i++)
+		__cexception_unregister_thread(&handles[i]);
+	assertEqual(__cexception_get_active_thread_count(), 0);
+
+	tearDown();
+}
+
+test(CException_Group3_TaskNumberFromHandle)
+{
+	setUp();
+
+	static FakeThread handles[64];
+	unsigned int slots[64];
+
+	//register enough handles to collide in the index and to force growth
+	for(unsigned int i = 0; i < 64; i++)
+		slots[i] = __cexception_register_thread(&handles[i], "Fake", nullptr);
+
+	//verify every handle resolves to the slot it was registered in
+	for(unsigned int i = 0; i < 64; i++)
+		assertEqual(__cexception_get_task_number(&handles[i]), slots[i]);
+
+	//unregister every other handle and verify the rest are still found
+	for(unsigned int i = 0; i < 64; i += 2)
+		__cexception_unregister_thread(&handles[i]);
+	for(unsigned int i = 0; i < 64; i++)
+		assertEqual(__cexception_get_task_number(&handles[i]), i % 2 ? slots[i] : 0);
+
+	//unknown handles are not registered
+	assertEqual(__cexception_get_task_number(&slots[0]), 0);
+
+	for(unsigned int i = 1; i < 64; i += 2)
+		__cexception_unregister_thread(&handles[i]);
+	assertEqual(__cexception_get_active_thread_count(), 0);
+
+	tearDown();
+}
+
+static FakeThread churnHandles[4][16];
+static volatile int churnDone;
+static std::atomic<unsigned int> churnReady(0);
+static std::atomic<bool> churnGo(false);
+static std::atomic<unsigned int> churnHolding(0);
+static std::atomic<unsigned int> churnHoldingMax(0);
+
+static void registryChurnThread(void* arg) {
+	FakeThread* handles = (FakeThread*)arg;
+	startBarrier(churnReady, churnGo);
+	for(int n = 0; n < 200; n++) {
+		for(int i = 0; i < 16; i++)
+			__cexception_register_thread(&handles[i], "Fake", nullptr);
+		//let the others run while this thread's handles are in the table
+		unsigned int holding = churnHolding.fetch_add(1) + 1;
+		unsigned int max = churnHoldingMax.load();
+		while(holding > max && !churnHoldingMax.compare_exchange_weak(max, holding))
+			;
+		os_thread_yield();
+		churnHolding.fetch_sub(1);
+		for(int i = 0; i < 16; i++)
+			__cexception_unregister_thread(&handles[i]);
+	}
+	__atomic_fetch_add(&churnDone, 1, __ATOMIC_SEQ_CST);
+}
+
+test(CException_Group3_ConcurrentRegisterUnregister)
+{
+	setUp();
+
+	churnDone = 0;
+	churnReady = 0;
+	churnGo = false;
+	churnHoldingMax = 0;
+	bool caught = false;
+	CEXCEPTION_T e;
+	Try {
+		for(int t = 0; t < 4; t++)
+			NEW_THREAD(nullptr, "Churn", OS_THREAD_PRIORITY_DEFAULT, registryChurnThread, churnHandles[t], OS_THREAD_STACK_SIZE_DEFAULT, exceptionCallback);
+	} Catch(e) {
+		caught = true;
+	}
+	assertFalse(caught);
+	while(churnReady.load() < 4)
+		os_thread_yield();
+	churnGo = true;
+	assertTrue(waitForThreads(0, 5000));
+
+	//the threads' registrations overlapped; every slot was returned, and unregistering a handle twice
+	//releases it only once
+	assertEqual((int)churnDone, 4);
+	assertTrue(churnHoldingMax.load() >= 2);
+	assertEqual(__cexception_get_active_thread_count(), 0);
+	__cexception_register_thread(&churnHandles[0][0], "Fake", nullptr);
+	__cexception_unregister_thread(&churnHandles[0][0]);
+	__cexception_unregister_thread(&churnHandles[0][0]);
+	assertEqual(__cexception_get_active_thread_count(), 0);
+
+	tearDown();
+}
+
+test(CException_Group3_EventQueueCountsEveryPost)
+{
+	setUp();
+
+	//start once the reporter is done with the records of earlier tests
+	CExceptionEventStats before, after;
+	for(int i = 0; i < 100; i++) {
+		__cexception_get_event_stats(&before);
+		if(before.reported == before.posted)
+			break;
+		delay(10);
+	}
+	assertEqual(before.reported, before.posted);
+
+	//post faster than the reporter drains: every record is either queued or counted as dropped
+	int accepted = 0;
+	for(int i = 0; i < 4 * CEXCEPTION_EVENT_QUEUE_SIZE; i++)
+		accepted += __cexception_post_event(CEXCEPTION_EVENT_THREAD_STARTED, CEXCEPTION_NONE, nullptr);
+	for(int i = 0; i < 100; i++) {
+		__cexception_get_event_stats(&after);
+		if(after.reported - before.reported == (uint32_t)accepted)
+			break;
+		delay(10);
+	}
+
+	assertEqual(after.posted - before.posted, (uint32_t)accepted);
+	assertEqual((after.posted - before.posted) + (after.dropped - before.dropped), (uint32_t)(4 * CEXCEPTION_EVENT_QUEUE_SIZE));
+	assertEqual(after.reported - before.reported, (uint32_t)accepted);
+	assertTrue(after.highWater <= CEXCEPTION_EVENT_QUEUE_SIZE);
+
+	tearDown();
+}
+
+static volatile int traceSink;
+
+static __attribute__((noinline)) void throwForTrace() {
+	Throw(0x7ace);
+	traceSink++; //keeps Throw from being a tail call
+}
+
+test(CException_Group3_TraceRecordsThrowSite)
+{
+	setUp();
+
+	static uint8_t dump[sizeof(CExceptionTraceHeader) + CEXCEPTION_TRACE_RECORDS * sizeof(CExceptionTraceRecord)];
+	assertEqual(__cexception_trace_dump(nullptr, 0), sizeof(dump));
+
+	CEXCEPTION_T e;
+	Try {
+		throwForTrace();
+	} Catch(e) {
+	}
+	size_t used = __cexception_trace_dump(dump, sizeof(dump));
+
+	CExceptionTraceHeader* header = (CExceptionTraceHeader*)dump;
+	CExceptionTraceRecord* records = (CExceptionTraceRecord*)(header + 1);
+	assertEqual(header->magic, CEXCEPTION_TRACE_MAGIC);
+	assertEqual(header->recordSize, sizeof(CExceptionTraceRecord));
+	assertTrue(header->recordCount > 0);
+	assertEqual(used, sizeof(CExceptionTraceHeader) + header->recordCount * sizeof(CExceptionTraceRecord));
+
+	//records are oldest first, so ours is the last one; its site lies inside throwForTrace
+	CExceptionTraceRecord* last = &records[header->recordCount - 1];
+	assertEqual(last->sequence, header->written);
+	assertEqual(last->type, CEXCEPTION_TRACE_THROW);
+	assertEqual(last->exception, 0x7ace);
+	assertEqual(last->handle, (uint64_t)(uintptr_t)__cexception_get_current_thread_handle());
+	assertTrue(last->site > (uint64_t)(uintptr_t)throwForTrace && last->site < (uint64_t)(uintptr_t)throwForTrace + 64);
+
+	tearDown();
+}
+
+#if CEXCEPTION_METRICS
+#include "CException/CExceptionMetrics.h"
+
+static uint32_t latencyTotal(const CExceptionThreadMetrics& m) {
+	uint32_t total = 0;
+	for(unsigned int b = 0; b < CEXCEPTION_METRICS_LATENCY_BUCKETS; b++)
+		total += m.latency[b];
+	return total;
+}
+
+//throws counted for id, or with the other ids once earlier tests have filled the table
+static uint32_t idThrows(const CExceptionMetricsSnapshot& s, CEXCEPTION_T id) {
+	unsigned int used = 0;
+	for(unsigned int i = 0; i < CEXCEPTION_METRICS_IDS; i++)
+	{
+		if(s.ids[i].id == id)
+			return s.ids[i].throws;
+		if(s.ids[i].id != CEXCEPTION_NONE)
+			used++;
+	}
+	return used == CEXCEPTION_METRICS_IDS ? s.otherIdThrows : 0;
+}
+
+test(CException_Group3_MetricsCountTryThrowCatch)
+{
+	setUp();
+
+	unsigned int id = CEXCEPTION_GET_ID;
+	CExceptionThreadMetrics before, after;
+	CExceptionMetricsSnapshot totalBefore, totalAfter;
+	assertTrue(__cexception_thread_metrics(id, &before));
+	__cexception_metrics_snapshot(&totalBefore);
+
+	CEXCEPTION_T e;
+	for(int i = 0; i < 3; i++) {
+		Try {
+			Throw(0x3e7);
+		} Catch(e) {
+		}
+	}
+	Try {
+		ExitTry();
+	} Catch(e) {
+	}
+	Try {
+	} Catch(e) {
+	}
+
+	assertTrue(__cexception_thread_metrics(id, &after));
+	__cexception_metrics_snapshot(&totalAfter);
+
+	//ExitTry counts as a Try but neither as a throw nor as a catch
+	assertEqual(after.tries - before.tries, 5);
+	assertEqual(after.throws - before.throws, 3);
+	assertEqual(after.catches - before.catches, 3);
+	assertEqual(latencyTotal(after) - latencyTotal(before), 3);
+	assertEqual(idThrows(totalAfter, 0x3e7) - idThrows(totalBefore, 0x3e7), 3);
+	assertTrue(totalAfter.total.tries - totalBefore.total.tries >= 5);
+	assertFalse(__cexception_thread_metrics(__cexception_get_number_of_threads(), &after));
+
+	tearDown();
+}
+#endif
+
+#include "CException/CExceptionProfiler.h"
+
+static volatile int profileSink;
+
+static __attribute__((noinline)) void throwFromHotSite(CEXCEPTION_T id) {
+	CEXCEPTION_THROW_HERE(id);
+	profileSink++; //keeps the throw from being a tail call
+}
+
+#if CEXCEPTION_PROFILE_SITES
+test(CException_Group3_ProfilerFindsHotThrowSite)
+{
+	setUp();
+
+	__cexception_profile_reset();
+	CEXCEPTION_T e;
+	for(int i = 0; i < 64; i++) {
+		Try {
+			throwFromHotSite(0x407);
+		} Catch(e) {
+		}
+	}
+	Try {
+		Throw(0x408);
+	} Catch(e) {
+	}
+
+	CExceptionThrowSite sites[4];
+	unsigned int count = __cexception_hot_throw_sites(sites, 4);
+	assertEqual(count, 2);
+	assertEqual(sites[0].samples, 64 / CEXCEPTION_PROFILE_SAMPLE_RATE);
+	assertTrue((uintptr_t)sites[0].site > (uintptr_t)throwFromHotSite && (uintptr_t)sites[0].site < (uintptr_t)throwFromHotSite + 64);
+	assertTrue(sites[0].file != nullptr && strstr(sites[0].file, "tests.cpp") != nullptr);
+	assertTrue(sites[0].line != 0);
+	assertTrue(sites[1].file == nullptr);
+
+	tearDown();
+}
+#endif
+
+test(CException_Group3_LastThrowSiteIsRecorded)
+{
+	setUp();
+
+	CEXCEPTION_T e;
+	CExceptionThrowSite site;
+	Try {
+		throwFromHotSite(0x409);
+	} Catch(e) {
+		__cexception_get_last_throw_site(&site);
+	}
+	assertEqual(e, 0x409);
+	assertTrue((uintptr_t)site.site > (uintptr_t)throwFromHotSite && (uintptr_t)site.site < (uintptr_t)throwFromHotSite + 64);
+	assertTrue(site.file != nullptr && strstr(site.file, "tests.cpp") != nullptr);
+	assertTrue(site.line != 0);
+
+	tearDown();
+}
+
+#if CEXCEPTION_BACKTRACE_DEPTH
+#include "CException/CExceptionBacktrace.h"
+
+static volatile int backtraceSink;
+
+static __attribute__((noinline)) void backtraceLeaf() {
+	Throw(0xb7);
+	backtraceSink++;
+}
+
+static __attribute__((noinline)) void backtraceMiddle() {
+	backtraceLeaf();
+	backtraceSink++;
+}
+
+static __attribute__((noinline)) void backtraceOuter() {
+	backtraceMiddle();
+	backtraceSink++;
+}
+
+static __attribute__((noinline)) void backtraceFault() {
+	((void(*)())(0xdeadbeef))();
+	backtraceSink++;
+}
+
+static bool returnsInto(const void* address, void(*function)()) {
+	return (uintptr_t)address > (uintptr_t)function && (uintptr_t)address < (uintptr_t)function + 64;
+}
+
+test(CException_Group3_BacktraceOnThrow)
+{
+	setUp();
+
+	//main is not started by NEW_THREAD; capture only uses bounds cached outside the throw path
+	__cexception_backtrace_thread_start();
+	CEXCEPTION_T e;
+	const void* frames[CEXCEPTION_BACKTRACE_DEPTH];
+	unsigned int count = 0;
+	Try {
+		backtraceOuter();
+	} Catch(e) {
+		count = __cexception_get_backtrace(frames, CEXCEPTION_BACKTRACE_DEPTH);
+	}
+
+	//innermost first: the Throw site, then each caller, then this test and whatever called it
+	assertTrue(count > 3);
+	assertTrue(returnsInto(frames[0], backtraceLeaf));
+	assertTrue(returnsInto(frames[1], backtraceMiddle));
+	assertTrue(returnsInto(frames[2], backtraceOuter));
+
+	//the capture is bounded by the buffer
+	assertEqual(__cexception_get_backtrace(frames, 2), 2);
+
+	tearDown();
+}
+
+#ifdef CEXCEPTION_PLATFORM_HOST
+static volatile unsigned int rawThreadBacktrace;
+static volatile bool rawThreadDone;
+
+static void rawThreadThrow(void*) {
+	CEXCEPTION_T e;
+	const void* frames[CEXCEPTION_BACKTRACE_DEPTH];
+	Try {
+		backtraceOuter();
+	} Catch(e) {
+		rawThreadBacktrace = __cexception_get_backtrace(frames, CEXCEPTION_BACKTRACE_DEPTH);
+	}
+	rawThreadDone = true;
+}
+
+test(CException_Group3_BacktraceWithoutStackBoundsStopsAtThrowSite)
+{
+	setUp();
+
+	//a thread that never registered has no cached bounds: only the throw site is recorded
+	rawThreadBacktrace = 0;
+	rawThreadDone = false;
+	os_thread_t thread = nullptr;
+	os_thread_create(&thread, "Raw", OS_THREAD_PRIORITY_DEFAULT, rawThreadThrow, nullptr, OS_THREAD_STACK_SIZE_DEFAULT);
+	for(int i = 0; i < 1000 && !rawThreadDone; i++)
+		delay(1);
+	assertTrue(rawThreadDone);
+	assertEqual((int)rawThreadBacktrace, 1);
+
+	tearDown();
+}
+
+test(CException_Group3_BacktraceOnFault)
+{
+	setUp();
+
+	assertTestPass(CException_Group1_Activate_Hardware_Handlers);
+
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	const void* frames[CEXCEPTION_BACKTRACE_DEPTH];
+	unsigned int count = 0;
+	Try {
+		backtraceFault();
+	} Catch(e) {
+		count = __cexception_get_backtrace(frames, CEXCEPTION_BACKTRACE_DEPTH);
+	}
+
+	assertEqual(e, EXCEPTION_HARDWARE);
+	assertTrue(count > 1);
+	assertEqual((uintptr_t)frames[0], 0xdeadbeef);
+	assertTrue(returnsInto(frames[1], backtraceFault));
+
+	tearDown();
+}
+#endif
+#endif
+
+#if CEXCEPTION_ARENA_SIZE
+#include "CException/CExceptionArena.h"
+
+static __attribute__((noinline)) void allocateAndThrow(CEXCEPTION_T id) {
+	memset(CEXCEPTION_ARENA_ALLOC(256), 0xa5, 256);
+	Throw(id);
+}
+
+test(CException_Group3_ArenaRewindsOnEveryExit)
+{
+	setUp();
+
+	CEXCEPTION_T e;
+	size_t empty = __cexception_arena_available();
+	void* outer = nullptr;
+	Try {
+		outer = CEXCEPTION_ARENA_ALLOC(100);
+		size_t afterOuter = __cexception_arena_available();
+		assertTrue(afterOuter <= empty - 100);
+		assertEqual((uintptr_t)outer % CEXCEPTION_ARENA_ALIGN, 0);
+
+		//normal exit
+		Try {
+			CEXCEPTION_ARENA_ALLOC(64);
+		} Catch(e) {
+		}
+		assertEqual(__cexception_arena_available(), afterOuter);
+
+		//ExitTry
+		Try {
+			CEXCEPTION_ARENA_ALLOC(64);
+			ExitTry();
+		} Catch(e) {
+		}
+		assertEqual(__cexception_arena_available(), afterOuter);
+
+		//Throw from a nested function
+		Try {
+			allocateAndThrow(0xa4e);
+		} Catch(e) {
+			assertEqual(e, 0xa4e);
+		}
+		assertEqual(__cexception_arena_available(), afterOuter);
+
+		//exhaustion throws instead of returning null
+		e = CEXCEPTION_NONE;
+		Try {
+			CEXCEPTION_ARENA_ALLOC(CEXCEPTION_ARENA_SIZE);
+		} Catch(e) {
+		}
+		assertEqual(e, EXCEPTION_OUT_OF_MEM);
+		assertEqual(__cexception_arena_available(), afterOuter);
+
+		//the same memory is handed out again
+		Try {
+			assertTrue(CEXCEPTION_ARENA_ALLOC(1) == (uint8_t*)outer + ((100 + CEXCEPTION_ARENA_ALIGN - 1) & ~(CEXCEPTION_ARENA_ALIGN - 1)));
+		} Catch(e) {
+		}
+	} Catch(e) {
+	}
+	assertEqual(__cexception_arena_available(), empty);
+
+	tearDown();
+}
+#endif
+
+#include "CException/CExceptionIds.h"
+
+#define TEST_CATEGORY_NET 0x0101
+#define TEST_CATEGORY_STORAGE 0x0102
+#define TEST_NET_TIMEOUT CEXCEPTION_ID(TEST_CATEGORY_NET, 1)
+#define TEST_STORAGE_FULL CEXCEPTION_ID(TEST_CATEGORY_STORAGE, 1)
+
+constexpr cexception::Category testCategories[] = { { TEST_CATEGORY_NET, "net" }, { TEST_CATEGORY_STORAGE, "storage" } };
+constexpr CEXCEPTION_T testIds[] = { TEST_NET_TIMEOUT, TEST_STORAGE_FULL };
+CEXCEPTION_CHECK_CATEGORIES(testCategories);
+CEXCEPTION_CHECK_IDS(testIds, testCategories);
+static_assert(cexception::category_of(TEST_STORAGE_FULL) == TEST_CATEGORY_STORAGE, "category_of");
+
+static unsigned int filterCleanups;
+
+test(CException_Group3_TryForSkipsUnmatchedIds)
+{
+	setUp();
+
+	assertTrue(strcmp(cexception::category_name(testCategories, TEST_NET_TIMEOUT), "net") == 0);
+
+	CEXCEPTION_T outer = CEXCEPTION_NONE, inner = CEXCEPTION_NONE;
+	bool innerCaught = false;
+	filterCleanups = 0;
+	Try {
+		TryFor(CEXCEPTION_MATCH_CATEGORY(TEST_CATEGORY_NET)) {
+			BEGIN_CLEANUP([]() { filterCleanups++; })
+			{
+				Throw(TEST_STORAGE_FULL);
+			} END_CLEANUP();
+		} Catch(inner) {
+			innerCaught = true;
+		}
+	} Catch(outer) {
+	}
+	//went straight past the filtered Try, running the cleanup on the way
+	assertFalse(innerCaught);
+	assertEqual(outer, TEST_STORAGE_FULL);
+	assertEqual(filterCleanups, 1);
+	assertTrue(CEXCEPTION_GET_FRAME->Filters == nullptr);
+
+	//a matching id is caught by the filtered Try
+	outer = CEXCEPTION_NONE;
+	Try {
+		TryFor(CEXCEPTION_MATCH_CATEGORY(TEST_CATEGORY_NET)) {
+			Throw(TEST_NET_TIMEOUT);
+		} Catch(inner) {
+			innerCaught = true;
+		}
+	} Catch(outer) {
+	}
+	assertTrue(innerCaught);
+	assertEqual(inner, TEST_NET_TIMEOUT);
+	assertEqual(outer, CEXCEPTION_NONE);
+
+	//ExitTry leaves the filtered Try itself
+	bool afterExit = false;
+	Try {
+		TryFor(CEXCEPTION_MATCH_ID(TEST_NET_TIMEOUT)) {
+			ExitTry();
+		} Catch(inner) {
+		}
+		afterExit = true;
+	} Catch(outer) {
+	}
+	assertTrue(afterExit);
+	assertTrue(CEXCEPTION_GET_FRAME->Filters == nullptr);
+
+	tearDown();
+}
+
+static __attribute__((noinline)) int parseDigit(char c) {
+	if(c < '0' || c > '9')
+		Throw(TEST_NET_TIMEOUT);
+	return c - '0';
+}
+
+test(CException_Group3_AttemptRunsHandlerAfterBody)
+{
+	setUp();
+
+	//nothing thrown: the handler does not run
+	int handled = 0;
+	CEXCEPTION_T e = cexception::attempt([&]() { parseDigit('1'); }, [&](CEXCEPTION_T) { handled++; });
+	assertEqual(e, CEXCEPTION_NONE);
+	assertEqual(handled, 0);
+
+	//a plain local changed in the body keeps its value through the throw
+	int parsed = 0;
+	e = cexception::attempt([&]() {
+		parsed = parseDigit('4');
+		parsed += parseDigit('x');
+	}, [&](CEXCEPTION_T id) {
+		handled++;
+		assertEqual(id, TEST_NET_TIMEOUT);
+	});
+	assertEqual(e, TEST_NET_TIMEOUT);
+	assertEqual(handled, 1);
+	assertEqual(parsed, 4);
+
+	//nested levels share one context; a throw from the inner handler goes to the outer level
+	cexception::Context ctx;
+	CEXCEPTION_T inner = CEXCEPTION_NONE;
+	e = ctx.attempt([&]() {
+		inner = ctx.attempt([&]() { Throw(0x33); }, [&](CEXCEPTION_T id) { Throw(id + 1); });
+	}, [&](CEXCEPTION_T) { });
+	assertEqual(inner, CEXCEPTION_NONE);
+	assertEqual(e, 0x34);
+
+	//ExitTry leaves the body without running the handler, and an unmatched filter passes the id on
+	handled = 0;
+	e = ctx.attempt([&]() { ExitTry(); }, [&](CEXCEPTION_T) { handled++; });
+	assertEqual(e, CEXCEPTION_NONE);
+	e = ctx.attempt([&]() {
+		cexception::attempt_for(CEXCEPTION_MATCH_CATEGORY(TEST_CATEGORY_NET), [&]() { Throw(TEST_STORAGE_FULL); },
+				[&](CEXCEPTION_T) { handled++; });
+	}, [&](CEXCEPTION_T) { });
+	assertEqual(e, TEST_STORAGE_FULL);
+	assertEqual(handled, 0);
+	assertTrue(ctx.get()->Filters == nullptr);
+	assertTrue(ctx.get()->pFrame == nullptr);
+
+	tearDown();
+}
+
+test(CException_Group3_CatchHandlerControlsEnclosingLoop)
+{
+	setUp();
+
+	//break and continue in the handler reach the loop around the Try
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	int passes = 0, handled = 0;
+	for(int i = 0; i < 10; i++)
+	{
+		passes++;
+		Try {
+			if(i % 2)
+				Throw(0x40 + i);
+		} Catch(e) {
+			handled++;
+			if(i < 5)
+				continue;
+			break;
+		}
+	}
+	assertEqual(passes, 6);
+	assertEqual(handled, 3);
+	assertEqual(e, 0x45);
+
+	//any number of them on one line
+	CEXCEPTION_T e2 = CEXCEPTION_NONE;
+	Try { Throw(0x50); } Catch(e) { } Try { Try { Throw(0x51); } Catch(e2) { Throw(e2 + 1); } } Catch(e) { }
+	assertEqual(e2, 0x51);
+	assertEqual(e, 0x52);
+	assertTrue(CEXCEPTION_GET_FRAME->pFrame == nullptr);
+
+	tearDown();
+}
+
+static CExceptionPool* testPool;
+static volatile unsigned int poolRan;
+static volatile unsigned int poolFailed;
+static void* volatile poolFailedThread;
+
+static void poolCallback(CEXCEPTION_T e, CExceptionThreadInfo* info) {
+	if(e >= 0x1000 && (e - 0x1000) % 10 == 9)
+		__atomic_fetch_add(&poolFailed, 1, __ATOMIC_SEQ_CST);
+	poolFailedThread = info->handle;
+}
+
+static void poolTask(void* arg) {
+	uintptr_t n = (uintptr_t)arg;
+	if(n % 10 == 9)
+		Throw(0x1000 + n);
+	__atomic_fetch_add(&poolRan, 1, __ATOMIC_SEQ_CST);
+	//from a worker: goes to its own deque
+	if(n < 10)
+		POOL_SUBMIT(testPool, poolTask, (void*)(n + 100), poolCallback);
+}
+
+test(CException_Group3_PoolRunsTasksAndSurvivesThrows)
+{
+	setUp();
+
+	unsigned int before = reserveThreads(8);
+	poolRan = 0;
+	poolFailed = 0;
+	poolFailedThread = nullptr;
+
+	testPool = NEW_POOL("Pool", 3, OS_THREAD_PRIORITY_DEFAULT, OS_THREAD_STACK_SIZE_DEFAULT);
+	assertEqual(__cexception_get_active_thread_count(), before + 3);
+	for(uintptr_t n = 0; n < 200; n++)
+		POOL_SUBMIT(testPool, poolTask, (void*)n, poolCallback);
+	__cexception_pool_wait(testPool);
+
+	//every tenth task threw; the others ran, and so did the 9 tasks they submitted
+	CExceptionPoolStats stats;
+	__cexception_pool_stats(testPool, &stats);
+	assertEqual(stats.submitted, 209);
+	assertEqual(stats.completed, 209);
+	assertEqual(stats.failed, 20);
+	assertEqual((int)poolFailed, 20);
+	assertEqual((int)poolRan, 189);
+
+	//the callback got the worker's thread info, and the workers are still there
+	assertTrue(poolFailedThread != nullptr);
+	assertTrue(poolFailedThread != __cexception_get_current_thread_handle());
+	assertEqual(__cexception_get_active_thread_count(), before + 3);
+
+	__cexception_pool_destroy(testPool);
+	assertTrue(waitForThreads(before));
+
+	tearDown();
+}
+
+static CExceptionPool* parallelPool;
+static volatile uint32_t nestedSum;
+
+static uint32_t sumOfRange(const CExceptionRange* range) {
+	uint32_t sum = 0;
+	for(uint32_t i = range->begin; i < range->end; i++)
+		sum += i;
+	return sum;
+}
+
+static void nestedReduce(void*) {
+	//from a worker of the same pool: waits by running the loop's own runners
+	nestedSum = cexception::parallel_reduce(parallelPool, 0, 1000, 10, (uint32_t)0, sumOfRange,
+			[](uint32_t a, uint32_t b) { return a + b; });
+}
+
+test(CException_Group3_ParallelForCancelsOnFirstThrow)
+{
+	setUp();
+
+	unsigned int before = reserveThreads(8);
+	parallelPool = NEW_POOL("Parallel", 3, OS_THREAD_PRIORITY_DEFAULT, OS_THREAD_STACK_SIZE_DEFAULT);
+
+	uint32_t sum = cexception::parallel_reduce(parallelPool, 0, 1000, 7, (uint32_t)0, sumOfRange,
+			[](uint32_t a, uint32_t b) { return a + b; });
+	assertEqual(sum, 499500);
+
+	nestedSum = 0;
+	POOL_SUBMIT(parallelPool, nestedReduce, nullptr, nullptr);
+	__cexception_pool_wait(parallelPool);
+	assertEqual(nestedSum, 499500);
+
+	//chunk 0 fails; the other chunks wait at a checkpoint for the cancellation, and no new chunks start
+	volatile unsigned int started = 0;
+	volatile unsigned int finished = 0;
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	Try {
+		cexception::parallel_for(parallelPool, 0, 1000, 1, [&](const CExceptionRange* range) {
+			__atomic_fetch_add(&started, 1, __ATOMIC_SEQ_CST);
+			if(range->begin == 0)
+			{
+				CEXCEPTION_CURRENT_DATA[0] = 0xfeed;
+				Throw(0x2000);
+			}
+			for(int i = 0; i < 10000; i++)
+			{
+				CEXCEPTION_CHECKPOINT(range);
+				delay(1);
+			}
+			__atomic_fetch_add(&finished, 1, __ATOMIC_SEQ_CST);
+		});
+	} Catch(e) {
+	}
+	assertEqual(e, 0x2000);
+	assertEqual(CEXCEPTION_CURRENT_DATA[0], 0xfeed);
+	assertTrue(started <= 4);
+	assertEqual((int)finished, 0);
+
+	//the pool's workers caught nothing themselves
+	CExceptionPoolStats stats;
+	__cexception_pool_stats(parallelPool, &stats);
+	assertEqual(stats.failed, 0);
+
+	__cexception_pool_destroy(parallelPool);
+	assertTrue(waitForThreads(before));
+
+	tearDown();
+}
+
+#if CEXCEPTION_STACK_ARENA
+static volatile unsigned int stackThreadInUse;
+
+static void stackArenaThread(void*) {
+	CExceptionStackClassStats stats[1];
+	__cexception_stack_stats(stats, 1);
+	stackThreadInUse = stats[0].inUse;
+}
+
+test(CException_Group3_StackArenaRecyclesStacks)
+{
+	setUp();
+
+	unsigned int before = reserveThreads(2);
+	CExceptionStackClassStats stats[4];
+	unsigned int classes = __cexception_stack_stats(stats, 4);
+	assertTrue(classes > 0);
+	uint16_t inUse = stats[0].inUse;
+	uint32_t fallbacks = __cexception_stack_fallbacks();
+
+	//more threads one after the other than the smallest class has stacks: each must get a recycled one
+	for(unsigned int i = 0; i < stats[0].count * 3u; i++)
+	{
+		stackThreadInUse = 0;
+		NEW_THREAD(nullptr, "Stack", OS_THREAD_PRIORITY_DEFAULT, stackArenaThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+		assertTrue(waitForThreads(before));
+		assertEqual((int)stackThreadInUse, inUse + 1);
+		delay(2);
+	}
+	assertEqual(__cexception_get_active_thread_count(), before);
+	assertEqual(__cexception_stack_fallbacks(), fallbacks);
+	__cexception_stack_stats(stats, 4);
+	assertEqual(stats[0].inUse, inUse);
+	assertTrue(stats[0].highWater > inUse);
+
+	tearDown();
+}
+
+//fail this many of the next NEW_THREAD registrations as if memory were exhausted
+static std::atomic<unsigned int> failingRegistrations(0);
+
+extern "C" void __cexception_registration_hook() {
+	unsigned int failing = failingRegistrations.load();
+	while(failing && !failingRegistrations.compare_exchange_weak(failing, failing - 1))
+		;
+	if(failing)
+		Throw(EXCEPTION_OUT_OF_MEM);
+}
+
+test(CException_Group3_StackArenaReclaimsStackOfUnregisteredThread)
+{
+	setUp();
+
+	unsigned int before = reserveThreads(2);
+	CExceptionStackClassStats stats[1];
+	__cexception_stack_stats(stats, 1);
+	uint16_t inUse = stats[0].inUse;
+	uint32_t fallbacks = __cexception_stack_fallbacks();
+
+	//the thread starts on an arena stack, then its registration fails
+	CEXCEPTION_T e = CEXCEPTION_NONE;
+	failingRegistrations = 1;
+	Try {
+		NEW_THREAD(nullptr, "Unregistered", OS_THREAD_PRIORITY_DEFAULT, stackArenaThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+	} Catch(e) {
+	}
+	assertEqual(e, EXCEPTION_OUT_OF_MEM);
+	assertEqual(__cexception_get_active_thread_count(), before);
+	__cexception_stack_stats(stats, 1);
+	assertEqual(stats[0].inUse, inUse);
+
+	//every stack of the class is available again once the thread has ended
+	stackThreadInUse = 0;
+	for(unsigned int i = 0; i < stats[0].count * 2u; i++)
+	{
+		NEW_THREAD(nullptr, "Stack", OS_THREAD_PRIORITY_DEFAULT, stackArenaThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+		assertTrue(waitForThreads(before));
+		delay(2);
+	}
+	assertEqual(__cexception_stack_fallbacks(), fallbacks);
+
+	tearDown();
+}
+#endif
+
+#if CEXCEPTION_STACK_USAGE
+static volatile bool stackUsageRelease;
+static volatile bool stackUsageReady;
+
+static void useStack(unsigned int depth) {
+	volatile uint8_t buffer[1024];
+	buffer[0] = (uint8_t)depth;
+	if(depth > 1)
+		useStack(depth - 1);
+	buffer[sizeof(buffer) - 1] = buffer[0];
+}
+
+static void stackUsageThread(void*) {
+	CEXCEPTION_T e;
+	Try {
+		Try {
+			Try {
+				useStack(16);
+			} Catch(e) { }
+		} Catch(e) { }
+	} Catch(e) { }
+	stackUsageReady = true;
+	while(!stackUsageRelease)
+		delay(1);
+}
+
+static bool findStackUsage(unsigned int id, CExceptionStackUsage* found) {
+	CExceptionStackUsage usage[16];
+	unsigned int count = __cexception_stack_usage(usage, 16);
+	for(unsigned int i = 0; i < count && i < 16; i++)
+		if(usage[i].id == id)
+		{
+			*found = usage[i];
+			return true;
+		}
+	return false;
+}
+
+test(CException_Group3_StackUsageTracksPeakAndTryDepth)
+{
+	setUp();
+
+	unsigned int before = reserveThreads(2);
+	stackUsageRelease = false;
+	stackUsageReady = false;
+	void* thread = nullptr;
+	NEW_THREAD(&thread, "StackUsage", OS_THREAD_PRIORITY_DEFAULT, stackUsageThread, nullptr, OS_THREAD_STACK_SIZE_DEFAULT, nullptr);
+	for(int i = 0; i < 1000 && !stackUsageReady; i++)
+		delay(1);
+	assertTrue(stackUsageReady);
+
+	unsigned int id = __cexception_get_task_number(thread);
+	CExceptionStackUsage usage;
+	assertTrue(findStackUsage(id, &usage));
+	assertTrue(usage.handle == thread);
+	assertTrue(usage.stackSize >= OS_THREAD_STACK_SIZE_DEFAULT);
+	assertTrue(usage.stackPeak >= 16 * 1024);
+	assertTrue(usage.stackPeak < usage.stackSize);
+	//the thread wrapper's own Try is the first level
+	assertEqual(usage.tryDepthMax, 4);
+	assertEqual(usage.jmpBufBytes, 4 * sizeof(CEXCEPTION_JMP_BUF));
+	__cexception_dump_stack_usage();
+
+	//the slot keeps the figures once the thread has ended
+	stackUsageRelease = true;
+	assertTrue(waitForThreads(before));
+	CExceptionStackUsage ended;
+	assertTrue(findStackUsage(id, &ended));
+	assertTrue(ended.handle == nullptr);
+	assertTrue(ended.stackPeak >= usage.stackPeak);
+	assertEqual(ended.tryDepthMax, 4);
+
+	//unregistered threads share slot 0, whose depth is not tracked
+	CEXCEPTION_T e;
+	Try {
+		Try {
+			Throw(1);
+		} Catch(e) { }
+	} Catch(e) { }
+	assertEqual(__cexception_get_frame(0)->TryDepthMax, 0);
+
+	tearDown();
+}
+#endif
@@ -21,7 +21,7 @@ bool __cexception_internal_global_handler(CEXCEPTION_T e) {
 
 static void setUp(void)
 {
-    CExceptionFrames[0].pFrame = NULL;
+    __cexception_get_frame(0)->pFrame = NULL;
     TestingTheFallback = 0;
     __cexception_hangOnUnHandledGlobalException = false;
 }
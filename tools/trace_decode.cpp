@@ -0,0 +1,136 @@
+//Decode a CException binary trace (the output of __cexception_trace_dump) into text or JSON.
+//Usage: cexception_trace_decode [--json] <dump file | ->
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "CExceptionTrace.h"
+
+static const char* type_name(uint8_t type) {
+	switch(type)
+	{
+	case CEXCEPTION_TRACE_THROW: return "throw";
+	case CEXCEPTION_TRACE_FAULT: return "fault";
+	case CEXCEPTION_TRACE_THREAD_DIED: return "thread_died";
+	case CEXCEPTION_TRACE_UNHANDLED: return "unhandled";
+	default: return "unknown";
+	}
+}
+
+static bool read_all(FILE* f, std::vector<uint8_t>& out) {
+	uint8_t buffer[4096];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		out.insert(out.end(), buffer, buffer + n);
+	return !ferror(f);
+}
+
+static void print_text(const CExceptionTraceHeader& header, const std::vector<CExceptionTraceRecord>& records) {
+	printf("trace v%u: %u records, %u written since boot\n", header.version, (unsigned int)records.size(), header.written);
+	for(const CExceptionTraceRecord& r : records)
+	{
+		printf("#%-6u %10u us  %-11s  exception 0x%08x  slot %-3u  thread 0x%llx  site 0x%llx\n", r.sequence, r.timestamp,
+				type_name(r.type), r.exception, r.slot, (unsigned long long)r.handle, (unsigned long long)r.site);
+		if(r.dataWords)
+		{
+			printf("        data");
+			for(unsigned int i = 0; i < r.dataWords; i++)
+				printf(" %08x", r.data[i]);
+			printf("\n");
+		}
+	}
+}
+
+static void print_json(const CExceptionTraceHeader& header, const std::vector<CExceptionTraceRecord>& records) {
+	printf("{\n  \"version\": %u,\n  \"written\": %u,\n  \"records\": [\n", header.version, header.written);
+	for(size_t n = 0; n < records.size(); n++)
+	{
+		const CExceptionTraceRecord& r = records[n];
+		printf("    {\"sequence\": %u, \"timestamp_us\": %u, \"type\": \"%s\", \"exception\": \"0x%08x\", \"slot\": %u, "
+				"\"thread\": \"0x%llx\", \"site\": \"0x%llx\", \"data\": [", r.sequence, r.timestamp, type_name(r.type),
+				r.exception, r.slot, (unsigned long long)r.handle, (unsigned long long)r.site);
+		for(unsigned int i = 0; i < r.dataWords; i++)
+			printf("%s\"0x%08x\"", i ? ", " : "", r.data[i]);
+		printf("]}%s\n", n + 1 < records.size() ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	bool json = false;
+	const char* path = nullptr;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--json") == 0)
+			json = true;
+		else
+			path = argv[i];
+	}
+	if(path == nullptr)
+	{
+		fprintf(stderr, "usage: %s [--json] <dump file | ->\n", argv[0]);
+		return 2;
+	}
+
+	FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+	if(f == nullptr)
+	{
+		perror(path);
+		return 1;
+	}
+	std::vector<uint8_t> blob;
+	bool ok = read_all(f, blob);
+	if(f != stdin)
+		fclose(f);
+	if(!ok)
+	{
+		perror(path);
+		return 1;
+	}
+
+	CExceptionTraceHeader header;
+	if(blob.size() < sizeof(header))
+	{
+		fprintf(stderr, "%s: too short for a trace header\n", path);
+		return 1;
+	}
+	memcpy(&header, blob.data(), sizeof(header));
+	if(header.magic != CEXCEPTION_TRACE_MAGIC)
+	{
+		fprintf(stderr, "%s: not a CException trace\n", path);
+		return 1;
+	}
+	if(header.version != CEXCEPTION_TRACE_VERSION)
+		fprintf(stderr, "%s: trace version %u, decoder knows %u; decoding the common fields\n", path, header.version, CEXCEPTION_TRACE_VERSION);
+	if(header.recordSize < offsetof(CExceptionTraceRecord, data))
+	{
+		fprintf(stderr, "%s: record size %u is too small\n", path, header.recordSize);
+		return 1;
+	}
+
+	//newer versions may append fields: copy what this decoder knows and skip the rest
+	std::vector<CExceptionTraceRecord> records;
+	size_t offset = sizeof(header);
+	for(uint32_t i = 0; i < header.recordCount && offset + header.recordSize <= blob.size(); i++, offset += header.recordSize)
+	{
+		CExceptionTraceRecord r;
+		memset(&r, 0, sizeof(r));
+		memcpy(&r, &blob[offset], std::min<size_t>(header.recordSize, sizeof(r)));
+		if(r.sequence == 0)
+			continue;
+		if(r.dataWords > CEXCEPTION_TRACE_DATA_WORDS)
+			r.dataWords = CEXCEPTION_TRACE_DATA_WORDS;
+		records.push_back(r);
+	}
+	std::sort(records.begin(), records.end(), [](const CExceptionTraceRecord& a, const CExceptionTraceRecord& b) {
+		return (int32_t)(a.sequence - b.sequence) < 0;
+	});
+
+	if(json)
+		print_json(header, records);
+	else
+		print_text(header, records);
+	return 0;
+}